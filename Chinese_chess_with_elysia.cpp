@@ -10,6 +10,8 @@
 */
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <algorithm>
 #include <string>
 #include <map>
@@ -19,10 +21,20 @@
 #include <stdexcept>
 #include <limits>
 #include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <chrono>
 #include <span>
+#include <optional>
+#include <type_traits>
 #include <cstdint>
 #include <cstdlib>
+#include <cmath>
+#include <numeric>
 #include <cassert>
 
 #ifdef _WIN32
@@ -30,6 +42,17 @@
 #include <windows.h>
 #endif
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
 enum class Side {
     up,
     down,
@@ -48,76 +71,59 @@ enum class Type {
     out
 };
 
-using Piece = char;
-
-static constexpr Piece P_UP = 'P';
-static constexpr Piece P_UC = 'C';
-static constexpr Piece P_UR = 'R';
-static constexpr Piece P_UN = 'N';
-static constexpr Piece P_UB = 'B';
-static constexpr Piece P_UA = 'A';
-static constexpr Piece P_UG = 'G';
-static constexpr Piece P_DP = 'p';
-static constexpr Piece P_DC = 'c';
-static constexpr Piece P_DR = 'r';
-static constexpr Piece P_DN = 'n';
-static constexpr Piece P_DB = 'b';
-static constexpr Piece P_DA = 'a';
-static constexpr Piece P_DG = 'g';
-static constexpr Piece P_EE = '.';
-static constexpr Piece P_EO = '#';
+// the side sits above the low four bits and the type in them, so piece_side and piece_type are a shift
+// and a mask. empty and out of board squares belong to Side::extra.
+using Piece = uint8_t;
+
+constexpr Piece make_piece(Side s, Type t) noexcept {
+    return static_cast<Piece>((static_cast<uint8_t>(s) << 4) | static_cast<uint8_t>(t));
+}
+
+static constexpr Piece P_UP = make_piece(Side::up, Type::pawn);
+static constexpr Piece P_UC = make_piece(Side::up, Type::cannon);
+static constexpr Piece P_UR = make_piece(Side::up, Type::rook);
+static constexpr Piece P_UN = make_piece(Side::up, Type::knight);
+static constexpr Piece P_UB = make_piece(Side::up, Type::bishop);
+static constexpr Piece P_UA = make_piece(Side::up, Type::advisor);
+static constexpr Piece P_UG = make_piece(Side::up, Type::general);
+static constexpr Piece P_DP = make_piece(Side::down, Type::pawn);
+static constexpr Piece P_DC = make_piece(Side::down, Type::cannon);
+static constexpr Piece P_DR = make_piece(Side::down, Type::rook);
+static constexpr Piece P_DN = make_piece(Side::down, Type::knight);
+static constexpr Piece P_DB = make_piece(Side::down, Type::bishop);
+static constexpr Piece P_DA = make_piece(Side::down, Type::advisor);
+static constexpr Piece P_DG = make_piece(Side::down, Type::general);
+static constexpr Piece P_EE = make_piece(Side::extra, Type::empty);
+static constexpr Piece P_EO = make_piece(Side::extra, Type::out);
 
 constexpr Side piece_side(Piece p) noexcept {
-    switch(p) {
-        case P_UP:
-        case P_UC:
-        case P_UR:
-        case P_UN:
-        case P_UB:
-        case P_UA:
-        case P_UG:
-            return Side::up;
-        case P_DP:
-        case P_DC:
-        case P_DR:
-        case P_DN:
-        case P_DB:
-        case P_DA:
-        case P_DG:
-            return Side::down;
-        default:
-            return Side::extra;
-    }
+    return static_cast<Side>(p >> 4);
 }
 
 constexpr Type piece_type(Piece p) noexcept {
-    if (p == P_UP || p == P_DP) {
-        return Type::pawn;
-    }
-    else if (p == P_UC || p == P_DC) {
-        return Type::cannon;
-    }
-    else if (p == P_UR || p == P_DR) {
-        return Type::rook;
-    }
-    else if (p == P_UN || p == P_DN) {
-        return Type::knight;
-    }
-    else if (p == P_UB || p == P_DB) {
-        return Type::bishop;
-    }
-    else if (p == P_UA || p == P_DA) {
-        return Type::advisor;
-    }
-    else if (p == P_UG || p== P_DG) {
-        return Type::general;
-    }
-    else if (p == P_EE) {
-        return Type::empty;
+    return static_cast<Type>(p & 0x0f);
+}
+
+// the letter shown on the console, upper side pieces in capitals.
+constexpr char piece_char(Piece p) noexcept {
+    switch (piece_side(p)) {
+        case Side::up:
+            return "PCRNBAG"[p & 0x0f];
+        case Side::down:
+            return "pcrnbag"[p & 0x0f];
+        default:
+            return p == P_EE ? '.' : '#';
     }
-    else {
-        return Type::out;
+}
+
+constexpr Piece char_to_piece(char ch) noexcept {
+    for (Piece p : { P_UP, P_UC, P_UR, P_UN, P_UB, P_UA, P_UG, P_DP, P_DC, P_DR, P_DN, P_DB, P_DA, P_DG, P_EE }) {
+        if (piece_char(p) == ch) {
+            return p;
+        }
     }
+
+    return P_EO;
 }
 
 constexpr Side piece_side_reverse(Side s) noexcept {
@@ -131,6 +137,11 @@ constexpr Side piece_side_reverse(Side s) noexcept {
     }
 }
 
+// 0 to 6 for the upper side pieces, 7 to 13 for the down side, -1 for empty and out of board.
+constexpr int32_t piece_index(Piece p) noexcept {
+    return piece_side(p) == Side::extra ? -1 : (p >> 4) * 7 + (p & 0x0f);
+}
+
 struct Pos {
     int32_t row;
     int32_t col;
@@ -170,10 +181,73 @@ struct HistoryNode {
     {}
 };
 
-class Board {
+// random keys for hashing positions, made at compile time so every run hashes the same.
+class Zobrist {
+public:
+    static constexpr int32_t piece_kinds = 14;
+    static constexpr int32_t square_num = 14 * 16;     // Board::row_num * Board::col_num.
+
+    using Keys = std::array<uint64_t, piece_kinds * square_num>;
+private:
+    static constexpr uint64_t splitmix64(uint64_t& state) noexcept {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    static constexpr Keys make_keys() noexcept {
+        Keys keys{};
+        uint64_t state = 0x454C59534941ull;
+
+        for (uint64_t& key : keys) {
+            key = splitmix64(state);
+        }
+
+        return keys;
+    }
+public:
+    // toggled by every move, so the same placement with the other side to move hashes differently.
+    static constexpr uint64_t side_key = 0xF1D3A1E5C0FFEE11ull;
+
+    static uint64_t piece_key(Piece p, int32_t square) noexcept {
+        static constexpr Keys keys = make_keys();
+
+        int32_t index = piece_index(p);
+        return index < 0 ? 0 : keys[index * square_num + square];
+    }
+};
+
+static_assert(14 * 16 <= 256, "squares are packed into 8 bits");
+
+// the pieces, the hash and the material score and nothing else, so it is trivially copyable and a search
+// can copy it for every ply instead of taking moves back.
+class Position {
 public:
+    // 2 rows of padding above and below, 2 columns on the left and 5 on the right, so a row is 16 squares
+    // wide: a square is row << 4 | col, and a step in any direction adds the same offset everywhere.
     static constexpr int32_t row_num = 14;
-    static constexpr int32_t col_num = 13;
+    static constexpr int32_t col_num = 16;
+    static constexpr int32_t col_bits = 4;
+
+    static constexpr int32_t step_up = -col_num;
+    static constexpr int32_t step_down = col_num;
+    static constexpr int32_t step_left = -1;
+    static constexpr int32_t step_right = 1;
+
+    static constexpr int32_t rays[4] = { step_up, step_down, step_left, step_right };
+    static constexpr int32_t diagonals[4] = {
+        step_up + step_left, step_up + step_right,
+        step_down + step_left, step_down + step_right,
+    };
+
+    // where a knight goes, and the leg next to it that has to be empty.
+    static constexpr int32_t knight_moves[8][2] = {
+        { 2 * step_down + step_right, step_down }, { 2 * step_down + step_left, step_down },
+        { 2 * step_up + step_right, step_up }, { 2 * step_up + step_left, step_up },
+        { step_down + 2 * step_right, step_right }, { step_up + 2 * step_right, step_right },
+        { step_down + 2 * step_left, step_left }, { step_up + 2 * step_left, step_left },
+    };
 
     static constexpr int32_t real_row_num = 10;
     static constexpr int32_t real_col_num = 9;
@@ -198,376 +272,761 @@ public:
     static constexpr int32_t nine_palace_down_bottom = 11;
     static constexpr int32_t nine_palace_down_left = 5;
     static constexpr int32_t nine_palace_down_right = 7;
-private:
-    std::string data;
-    std::deque<HistoryNode> history;
+protected:
+    std::array<Piece, row_num * col_num> data;
+    uint64_t hashKey;
+    int32_t materialScore;
+
+    // piece value plus piece square value by piece_index and square, filled by ScoreEvaluator::init_values.
+    // boards set up before that keep a material score of 0 until they are cleared or loaded again.
+    static inline std::array<std::array<int32_t, row_num * col_num>, 14> square_values{};
 
     void set(int32_t r, int32_t c, Piece p) noexcept {
-        data[r * col_num + c] = p;
+        data[square(r, c)] = p;
     }
 
     void set(Pos pos, Piece p) noexcept {
         set(pos.row, pos.col, p);
     }
+
+    // hash of the pieces, the side key is left to the caller.
+    uint64_t compute_hash() const noexcept {
+        uint64_t key = 0;
+
+        for (int32_t i = 0; i < row_num * col_num; ++i) {
+            key ^= Zobrist::piece_key(data[i], i);
+        }
+
+        return key;
+    }
+
+    // what mv toggles in the hash, the same for making and taking back a move.
+    static uint64_t hash_delta(const Move& mv, Piece fp, Piece tp) noexcept {
+        return Zobrist::piece_key(fp, square(mv.from)) ^ Zobrist::piece_key(fp, square(mv.to)) ^ Zobrist::piece_key(tp, square(mv.to)) ^ Zobrist::side_key;
+    }
+
+    void update_hash(const Move& mv, Piece fp, Piece tp) noexcept {
+        hashKey ^= hash_delta(mv, fp, tp);
+    }
+
+    static int32_t square_value(Piece p, int32_t sq) noexcept {
+        int32_t index = piece_index(p);
+        return index < 0 ? 0 : square_values[index][sq];
+    }
+
+    int32_t compute_material_score() const noexcept {
+        int32_t score = 0;
+
+        for (int32_t i = 0; i < row_num * col_num; ++i) {
+            score += square_value(data[i], i);
+        }
+
+        return score;
+    }
+
+    // what mv changes in the material score, undo takes the same amount away.
+    static int32_t material_delta(const Move& mv, Piece fp, Piece tp) noexcept {
+        return square_value(fp, square(mv.to)) - square_value(fp, square(mv.from)) - square_value(tp, square(mv.to));
+    }
 public:
-    Board() {
-        clear();
+    static constexpr int32_t square(int32_t r, int32_t c) noexcept {
+        return (r << col_bits) | c;
     }
 
-    void clear() {
-        data = "#############"
-                "#############"
-                "##RNBAGABNR##"
-                "##.........##"
-                "##.C.....C.##"
-                "##P.P.P.P.P##"
-                "##.........##"
-                "##.........##"
-                "##p.p.p.p.p##"
-                "##.c.....c.##"
-                "##.........##"
-                "##rnbagabnr##"
-                "#############"
-                "#############";
+    static int32_t square(Pos pos) noexcept {
+        return square(pos.row, pos.col);
+    }
 
-        history.clear();
+    static constexpr int32_t row_of(int32_t sq) noexcept {
+        return sq >> col_bits;
+    }
+
+    static constexpr int32_t col_of(int32_t sq) noexcept {
+        return sq & (col_num - 1);
+    }
+
+    static Pos to_pos(int32_t sq) noexcept {
+        return Pos{ row_of(sq), col_of(sq) };
+    }
+
+    static constexpr bool in_palace(int32_t sq, Side s) noexcept {
+        int32_t top = s == Side::up ? nine_palace_up_top : nine_palace_down_top;
+        int32_t bottom = s == Side::up ? nine_palace_up_bottom : nine_palace_down_bottom;
+        return row_of(sq) >= top && row_of(sq) <= bottom && col_of(sq) >= nine_palace_up_left && col_of(sq) <= nine_palace_up_right;
+    }
+
+    static void set_square_value(Piece p, Pos pos, int32_t value) noexcept {
+        square_values[piece_index(p)][square(pos)] = value;
+    }
+
+    // piece values plus piece square values, kept up to date by every move.
+    // upper is negative, down is positive.
+    int32_t material_score() const noexcept {
+        return materialScore;
+    }
+
+    uint64_t hash() const noexcept {
+        return hashKey;
+    }
+
+    // the hash of the position after mv, without making it.
+    uint64_t hash_after(const Move& mv) const noexcept {
+        return hashKey ^ hash_delta(mv, get(mv.from), get(mv.to));
     }
 
     Piece get(int32_t r, int32_t c) const noexcept {
-        return data[r * col_num + c];
+        return data[square(r, c)];
+    }
+
+    Piece at(int32_t sq) const noexcept {
+        return data[sq];
     }
 
     Piece get(Pos pos) const noexcept {
         return get(pos.row, pos.col);
     }
 
-    void move(const Move& mv) {
+    // returns Pos{} when the general has been taken.
+    Pos find_general(Side s) const noexcept {
+        Piece g = make_piece(s, Type::general);
+        int32_t top = s == Side::up ? nine_palace_up_top : nine_palace_down_top;
+        int32_t bottom = s == Side::up ? nine_palace_up_bottom : nine_palace_down_bottom;
+
+        for (int32_t r = top; r <= bottom; ++r) {
+            for (int32_t sq = square(r, nine_palace_up_left); sq <= square(r, nine_palace_up_right); ++sq) {
+                if (data[sq] == g) {
+                    return to_pos(sq);
+                }
+            }
+        }
+
+        return Pos{};
+    }
+
+    // plays mv with nothing to take it back by, for copy make searches. Board hides it, a board's moves
+    // go through Board::move.
+    void make(const Move& mv) noexcept {
         Piece fp = get(mv.from);
         Piece tp = get(mv.to);
 
-        history.emplace_back(mv, fp, tp);
-
         set(mv.from, P_EE);
         set(mv.to, fp);
+        update_hash(mv, fp, tp);
+        materialScore += material_delta(mv, fp, tp);
     }
+};
 
-    void undo() {
-        if (!history.empty()) {
-            const HistoryNode& hist = history.back();
+static_assert(std::is_trivially_copyable_v<Position>);
 
-            set(hist.mv.from, hist.fp);
-            set(hist.mv.to, hist.tp);
+class Board : public Position {
+public:
+    // a rank and a file through two squares hold at most 4 * 10 pieces, plus 8 knights and 8 bishops around.
+    static constexpr int32_t max_affected = 64;
 
-            history.pop_back();
-        }
-    }
-};
+    using AttackCounts = std::array<uint8_t, row_num * col_num>;
+private:
+    std::deque<HistoryNode> history;
 
-class MovesGen {
-    static void check_possible_move_and_insert(const Board& cb, std::vector<Move>& moves, int32_t beginRow, int32_t beginCol, int32_t endRow, int32_t endCol){
-        Piece beginP = cb.get(beginRow, beginCol);
-        Piece endP = cb.get(endRow, endCol);
+    // how many pieces of each side attack a square, only kept up to date while trackAttacks is on.
+    bool trackAttacks = false;
+    std::array<AttackCounts, 2> attackCounts{};
 
-        if (endP != P_EO && piece_side(beginP) != piece_side(endP)){   // not out of chess board, and not the same side.
-            moves.emplace_back(beginRow, beginCol, endRow, endCol);
-        }
-    }
+    // calls visit(square) for every square the piece on sq attacks, own pieces included.
+    // a general attacks its palace neighbours, and the other general when nothing stands between them.
+    template<typename Visit>
+    void for_each_attack(int32_t sq, Visit&& visit) const {
+        Piece p = data[sq];
+        Side s = piece_side(p);
+        int32_t forward = s == Side::up ? step_down : step_up;
 
-    static void gen_moves_pawn(const Board& cb, std::vector<Move>& moves, int32_t r, int32_t c, Side side){
-        if (side == Side::up){
-            check_possible_move_and_insert(cb, moves,  r, c, r + 1, c);
+        switch (piece_type(p)) {
+            case Type::pawn: {
+                bool crossed = s == Side::up ? row_of(sq) > river_up : row_of(sq) < river_down;
 
-            if (r > Board::river_up){    // cross the river ?
-                check_possible_move_and_insert(cb, moves, r, c, r, c - 1);
-                check_possible_move_and_insert(cb, moves, r, c, r, c + 1);
-            }
-        }
-        else if (side == Side::down){
-            check_possible_move_and_insert(cb, moves, r, c, r - 1, c);
+                if (data[sq + forward] != P_EO) {
+                    visit(sq + forward);
+                }
 
-            if (r < Board::river_down){
-                check_possible_move_and_insert(cb, moves, r, c, r, c - 1);
-                check_possible_move_and_insert(cb, moves, r, c, r, c + 1);
+                for (int32_t sideways : { step_left, step_right }) {
+                    if (crossed && data[sq + sideways] != P_EO) {
+                        visit(sq + sideways);
+                    }
+                }
+                break;
             }
-        }
-    }
+            case Type::rook:
+            case Type::cannon: {
+                bool isCannon = piece_type(p) == Type::cannon;
 
-    static void gen_moves_cannon_one_direction(const Board& cb, std::vector<Move>& moves, int32_t r, int32_t c, int32_t rGap, int32_t cGap, Side side){
-        int32_t row, col;
-        Piece p;
+                for (int32_t step : rays) {
+                    bool screened = false;
 
-        for (row = r + rGap, col = c + cGap; ;row += rGap, col += cGap){
-            p = cb.get(row, col);
+                    for (int32_t target = sq + step; data[target] != P_EO; target += step) {
+                        bool empty = data[target] == P_EE;
 
-            if (p == P_EE){    // empty piece, then insert it.
-                moves.emplace_back(r, c, row, col);
-            }
-            else {   // upper piece, down piece or out of chess board, break immediately.
+                        if (!isCannon || screened) {
+                            visit(target);
+                        }
+
+                        if (!empty) {
+                            if (!isCannon || screened) {
+                                break;
+                            }
+
+                            screened = true;
+                        }
+                    }
+                }
                 break;
             }
-        }
+            case Type::knight:
+                for (const auto& k : knight_moves) {
+                    if (data[sq + k[1]] == P_EE && data[sq + k[0]] != P_EO) {     // not a lame horse leg.
+                        visit(sq + k[0]);
+                    }
+                }
+                break;
+            case Type::bishop:
+                for (int32_t d : diagonals) {
+                    int32_t target = sq + 2 * d;
+                    bool ownHalf = s == Side::up ? row_of(target) <= river_up : row_of(target) >= river_down;
 
-        if (p != P_EO){   // not out of chess board, check if we can add an enemy piece.
-            for (row = row + rGap, col = col + cGap; ;row += rGap, col += cGap){
-                p = cb.get(row, col);
-            
-                if (p == P_EE){    // empty, then continue search.
-                    continue;
+                    if (ownHalf && data[target] != P_EO && data[sq + d] == P_EE) {
+                        visit(target);
+                    }
                 }
-                else if (piece_side(p) == piece_side_reverse(side)){   // enemy piece, then insert it and break.
-                    moves.emplace_back(r, c, row, col);
-                    break;
+                break;
+            case Type::advisor:
+                for (int32_t d : diagonals) {
+                    if (in_palace(sq + d, s)) {
+                        visit(sq + d);
+                    }
                 }
-                else {    // self side piece or out of chess board, break.
-                    break;
+                break;
+            case Type::general: {
+                for (int32_t step : rays) {
+                    if (in_palace(sq + step, s)) {
+                        visit(sq + step);
+                    }
+                }
+
+                int32_t target = sq + forward;
+                while (data[target] == P_EE) {
+                    target += forward;
                 }
+
+                if (data[target] == make_piece(piece_side_reverse(s), Type::general)) {
+                    visit(target);
+                }
+                break;
             }
+            default:
+                break;
         }
     }
 
-    static void gen_moves_cannon(const Board& cb, std::vector<Move>& moves, int32_t r, int32_t c, Side side){
-        // go up, down, left, right.
-        gen_moves_cannon_one_direction(cb, moves, r, c, -1, 0, side);
-        gen_moves_cannon_one_direction(cb, moves, r, c, +1, 0, side);
-        gen_moves_cannon_one_direction(cb, moves, r, c, 0, -1, side);
-        gen_moves_cannon_one_direction(cb, moves, r, c, 0, +1, side);
+    void add_attacks(std::array<AttackCounts, 2>& counts, int32_t sq, int32_t delta) const noexcept {
+        Side s = piece_side(data[sq]);
+        if (s == Side::extra) {
+            return;
+        }
+
+        auto& sideCounts = counts[s == Side::up ? 0 : 1];
+        for_each_attack(sq, [&sideCounts, delta](int32_t target) { sideCounts[target] += delta; });
     }
 
-    static void gen_moves_rook_one_direction(const Board& cb, std::vector<Move>& moves, int32_t r, int32_t c, int32_t rGap, int32_t cGap, Side side){
-        int32_t row, col;
-        Piece p;
+    // the pieces whose attacks may change when from and to change: whatever stands on them, sliders and
+    // generals on their rank and file, knights whose leg and bishops whose eye they are.
+    int32_t collect_affected(Pos from, Pos to, std::array<int32_t, max_affected>& squares) const noexcept {
+        int32_t count = 0;
+        auto add = [&squares, &count](int32_t sq) {
+            if (std::find(squares.begin(), squares.begin() + count, sq) == squares.begin() + count) {
+                squares[count++] = sq;
+            }
+        };
+
+        for (int32_t sq : { square(from), square(to) }) {
+            add(sq);
+
+            for (int32_t step : rays) {
+                for (int32_t target = sq + step; data[target] != P_EO; target += step) {
+                    Type t = piece_type(data[target]);
 
-        for (row = r + rGap, col = c + cGap; ;row += rGap, col += cGap){
-            p = cb.get(row, col);
+                    if (t == Type::rook || t == Type::cannon || (t == Type::general && (step == step_up || step == step_down))) {
+                        add(target);
+                    }
+                }
 
-            if (p == P_EE){    // empty piece, then insert it.
-                moves.emplace_back(r, c, row, col);
+                if (piece_type(data[sq + step]) == Type::knight) {
+                    add(sq + step);
+                }
             }
-            else {   // upper piece, down piece or out of chess board, break immediately.
-                break;
+
+            for (int32_t d : diagonals) {
+                if (piece_type(data[sq + d]) == Type::bishop) {
+                    add(sq + d);
+                }
             }
         }
 
-        if (piece_side(p) == piece_side_reverse(side)) {   // enemy piece, then insert it.
-            moves.emplace_back(r, c, row, col);
-        }
+        return count;
     }
 
-    static void gen_moves_rook(const Board& cb, std::vector<Move>& moves, int32_t r, int32_t c, Side side){
-        // go up, down, left, right.
-        gen_moves_rook_one_direction(cb, moves, r, c, -1, 0, side);
-        gen_moves_rook_one_direction(cb, moves, r, c, +1, 0, side);
-        gen_moves_rook_one_direction(cb, moves, r, c, 0, -1, side);
-        gen_moves_rook_one_direction(cb, moves, r, c, 0, +1, side);
-    }
+    // takes the attacks of the affected pieces away, changes the board, and adds them back.
+    template<typename Change>
+    void update_attacks(Pos from, Pos to, Change&& change) {
+        if (!trackAttacks) {
+            change();
+            return;
+        }
 
-    static void gen_moves_knight(const Board& cb, std::vector<Move>& moves, int32_t r, int32_t c, Side side){
-        Piece p;
-        if ((p = cb.get(r + 1, c)) == P_EE){    // if not lame horse leg ?
-            check_possible_move_and_insert(cb, moves, r, c, r + 2, c + 1);
-            check_possible_move_and_insert(cb, moves, r, c, r + 2, c - 1);
+        std::array<int32_t, max_affected> squares;
+        int32_t count = collect_affected(from, to, squares);
+        for (int32_t i = 0; i < count; ++i) {
+            add_attacks(attackCounts, squares[i], -1);
         }
 
-        if ((p = cb.get(r - 1, c)) == P_EE){
-            check_possible_move_and_insert(cb, moves, r, c, r - 2, c + 1);
-            check_possible_move_and_insert(cb, moves, r, c, r - 2, c - 1);
+        change();
+
+        count = collect_affected(from, to, squares);
+        for (int32_t i = 0; i < count; ++i) {
+            add_attacks(attackCounts, squares[i], +1);
         }
+    }
 
-        if ((p = cb.get(r, c + 1)) == P_EE){
-            check_possible_move_and_insert(cb, moves, r, c, r + 1, c + 2);
-            check_possible_move_and_insert(cb, moves, r, c, r - 1, c + 2);
+    void recompute_attacks() noexcept {
+        attackCounts = compute_attack_counts();
+    }
+
+    static Piece fen_char_to_piece(char ch) noexcept {
+        switch (ch) {
+            case 'P': return P_DP;
+            case 'C': return P_DC;
+            case 'R': return P_DR;
+            case 'N': case 'H': return P_DN;
+            case 'B': case 'E': return P_DB;
+            case 'A': return P_DA;
+            case 'K': return P_DG;
+            case 'p': return P_UP;
+            case 'c': return P_UC;
+            case 'r': return P_UR;
+            case 'n': case 'h': return P_UN;
+            case 'b': case 'e': return P_UB;
+            case 'a': return P_UA;
+            case 'k': return P_UG;
+            default: return P_EO;
         }
+    }
 
-        if ((p = cb.get(r, c - 1)) == P_EE){
-            check_possible_move_and_insert(cb, moves, r, c, r + 1, c - 2);
-            check_possible_move_and_insert(cb, moves, r, c, r - 1, c - 2);
+    static char piece_to_fen_char(Piece p) noexcept {
+        switch (p) {
+            case P_DP: return 'P';
+            case P_DC: return 'C';
+            case P_DR: return 'R';
+            case P_DN: return 'N';
+            case P_DB: return 'B';
+            case P_DA: return 'A';
+            case P_DG: return 'K';
+            case P_UP: return 'p';
+            case P_UC: return 'c';
+            case P_UR: return 'r';
+            case P_UN: return 'n';
+            case P_UB: return 'b';
+            case P_UA: return 'a';
+            case P_UG: return 'k';
+            default: return '?';
         }
     }
+public:
+    Board() {
+        clear();
+    }
 
-    static void gen_moves_bishop(const Board& cb, std::vector<Move>& moves, int32_t r, int32_t c, Side side){
-        Piece p;
-        if (side == Side::up){
-            if (r + 2 <= Board::river_up){       // bishop can't cross river.
-                if ((p = cb.get(r + 1, c + 1)) == P_EE){    // bishop can move only if Xiang Yan is empty.
-                    check_possible_move_and_insert(cb, moves, r, c, r + 2, c + 2);
-                }
+    void clear() {
+        const char* layout = "################"
+                             "################"
+                             "##RNBAGABNR#####"
+                             "##.........#####"
+                             "##.C.....C.#####"
+                             "##P.P.P.P.P#####"
+                             "##.........#####"
+                             "##.........#####"
+                             "##p.p.p.p.p#####"
+                             "##.c.....c.#####"
+                             "##.........#####"
+                             "##rnbagabnr#####"
+                             "################"
+                             "################";
+
+        std::transform(layout, layout + data.size(), data.begin(), char_to_piece);
 
-                if ((p = cb.get(r + 1, c - 1)) == P_EE){
-                    check_possible_move_and_insert(cb, moves, r, c, r + 2, c - 2);
-                }
-            }
+        history.clear();
+        hashKey = compute_hash();
+        materialScore = compute_material_score();
 
-            if ((p = cb.get(r - 1, c + 1)) == P_EE){
-                check_possible_move_and_insert(cb, moves, r, c, r - 2, c + 2);
-            }
+        if (trackAttacks) {
+            recompute_attacks();
+        }
+    }
 
-            if ((p = cb.get(r - 1, c - 1)) == P_EE){
-                check_possible_move_and_insert(cb, moves, r, c, r - 2, c - 2);
-            }
+    // attack maps cost time on every move, so only searches that ask for them pay for them.
+    void set_attack_tracking(bool on) noexcept {
+        trackAttacks = on;
+
+        if (on) {
+            recompute_attacks();
         }
-        else if (side == Side::down){
-            if (r - 2 >= Board::river_down){
-                if ((p = cb.get(r - 1, c + 1)) == P_EE){
-                    check_possible_move_and_insert(cb, moves, r, c, r - 2, c + 2);
-                }
+    }
 
-                if ((p = cb.get(r - 1, c - 1)) == P_EE){
-                    check_possible_move_and_insert(cb, moves, r, c, r - 2, c - 2);
-                }
-            }
+    bool tracks_attacks() const noexcept {
+        return trackAttacks;
+    }
 
-            if ((p = cb.get(r + 1, c + 1)) == P_EE){
-                check_possible_move_and_insert(cb, moves, r, c, r + 2, c + 2);
-            }
+    // how many pieces of side s attack pos, needs attack tracking.
+    int32_t attackers(Side s, Pos pos) const noexcept {
+        assert(trackAttacks && s != Side::extra);
+        return attackCounts[s == Side::up ? 0 : 1][square(pos)];
+    }
 
-            if ((p = cb.get(r + 1, c - 1)) == P_EE){
-                check_possible_move_and_insert(cb, moves, r, c, r + 2, c - 2);
-            }
+    // the same counts made from scratch, to check the incremental ones against.
+    std::array<AttackCounts, 2> compute_attack_counts() const noexcept {
+        std::array<AttackCounts, 2> counts{};
+
+        for (int32_t sq = 0; sq < row_num * col_num; ++sq) {
+            add_attacks(counts, sq, +1);
         }
+
+        return counts;
     }
 
-    static void gen_moves_advisor(const Board& cb, std::vector<Move>& moves, int32_t r, int32_t c, Side side){
-        if (side == Side::up){
-            if (r + 1 <= Board::nine_palace_up_bottom && c + 1 <= Board::nine_palace_up_right) {   // walk diagonal lines.
-                check_possible_move_and_insert(cb, moves, r, c, r + 1, c + 1);
-            }
+    const std::array<AttackCounts, 2>& attack_counts() const noexcept {
+        return attackCounts;
+    }
 
-            if (r + 1 <= Board::nine_palace_up_bottom && c - 1 >= Board::nine_palace_up_left) {
-                check_possible_move_and_insert(cb, moves, r, c, r + 1, c - 1);
+    // standard xiangqi FEN, red (uppercase there) is our down side and black is the upper side.
+    // returns the side to move, throws std::invalid_argument for a broken FEN.
+    Side load_fen(const std::string& fen) {
+        std::string placement = fen.substr(0, fen.find(' '));
+        std::string cells(real_row_num * real_col_num, P_EE);
+        size_t cell = 0;
+
+        for (char ch : placement) {
+            if (ch == '/') {
+                if (cell % real_col_num != 0) {
+                    throw std::invalid_argument{ "bad fen, rank length is not " + std::to_string(real_col_num) + ": " + fen };
+                }
             }
-
-            if (r - 1 >= Board::nine_palace_up_top && c + 1 <= Board::nine_palace_up_right) {
-                check_possible_move_and_insert(cb, moves, r, c, r - 1, c + 1);
+            else if (ch >= '1' && ch <= '9') {
+                cell += ch - '0';
             }
+            else {
+                Piece p = fen_char_to_piece(ch);
+                if (p == P_EO || cell >= cells.size()) {
+                    throw std::invalid_argument{ "bad fen: " + fen };
+                }
 
-            if (r - 1 >= Board::nine_palace_up_top && c - 1 >= Board::nine_palace_up_left) {
-                check_possible_move_and_insert(cb, moves, r, c, r - 1, c - 1);
+                cells[cell++] = p;
             }
         }
-        else if (side == Side::down){
-            if (r + 1 <= Board::nine_palace_down_bottom && c + 1 <= Board::nine_palace_down_right) {
-                check_possible_move_and_insert(cb, moves, r, c, r + 1, c + 1);
-            }
-
-            if (r + 1 <= Board::nine_palace_down_bottom && c - 1 >= Board::nine_palace_down_left) {
-                check_possible_move_and_insert(cb, moves, r, c, r + 1, c - 1);
-            }
 
-            if (r - 1 >= Board::nine_palace_down_top && c + 1 <= Board::nine_palace_down_right) {
-                check_possible_move_and_insert(cb, moves, r, c, r - 1, c + 1);
-            }
+        if (cell != cells.size()) {
+            throw std::invalid_argument{ "bad fen, wrong number of cells: " + fen };
+        }
 
-            if (r - 1 >= Board::nine_palace_down_top && c - 1 >= Board::nine_palace_down_left) {
-                check_possible_move_and_insert(cb, moves, r, c, r - 1, c - 1);
+        clear();
+        for (int32_t r = 0; r < real_row_num; ++r) {
+            for (int32_t c = 0; c < real_col_num; ++c) {
+                set(row_begin + r, col_begin + c, cells[r * real_col_num + c]);
             }
         }
-    }
 
-    static void gen_moves_general(const Board& cb, std::vector<Move>& moves, int32_t r, int32_t c, Side side){
-        Piece p;
-        int32_t row;
+        size_t sidePos = fen.find(' ');
+        hashKey = compute_hash();
+        materialScore = compute_material_score();
 
-        if (side == Side::up){
-            if (r + 1 <= Board::nine_palace_up_bottom){   // walk horizontal or vertical.
-                check_possible_move_and_insert(cb, moves, r, c, r + 1, c);
-            }
+        if (trackAttacks) {
+            recompute_attacks();
+        }
 
-            if (r - 1 >= Board::nine_palace_up_top){
-                check_possible_move_and_insert(cb, moves, r, c, r - 1, c);
-            }
+        if (sidePos != std::string::npos && sidePos + 1 < fen.size() && fen[sidePos + 1] == 'b') {
+            hashKey ^= Zobrist::side_key;
+            return Side::up;
+        }
 
-            if (c + 1 <= Board::nine_palace_up_right){
-                check_possible_move_and_insert(cb, moves, r, c, r, c + 1);
-            }
+        return Side::down;
+    }
 
-            if (c - 1 >= Board::nine_palace_up_left){
-                check_possible_move_and_insert(cb, moves, r, c, r, c - 1);
-            }
+    std::string to_fen(Side sideToMove) const {
+        std::string fen;
+
+        for (int32_t r = row_begin; r <= row_end; ++r) {
+            int32_t empty = 0;
 
-            // check if both generals faced each other directly.
-            for (row = r + 1; row <= Board::row_end ;++row){
-                p = cb.get(row, c);
+            for (int32_t c = col_begin; c <= col_end; ++c) {
+                Piece p = get(r, c);
 
-                if (p == P_EE){
+                if (p == P_EE) {
+                    ++empty;
                     continue;
                 }
-                else if (p == P_DG){
-                    moves.emplace_back(r, c, row, c);
-                    break;
-                }
-                else {
-                    break;
+
+                if (empty != 0) {
+                    fen += static_cast<char>('0' + empty);
+                    empty = 0;
                 }
-            }
-        }
-        else if (side == Side::down){
-            if (r + 1 <= Board::nine_palace_down_bottom){
-                check_possible_move_and_insert(cb, moves, r, c, r + 1, c);
-            }
 
-            if (r - 1 >= Board::nine_palace_down_top){
-                check_possible_move_and_insert(cb, moves, r, c, r - 1, c);
+                fen += piece_to_fen_char(p);
             }
 
-            if (c + 1 <= Board::nine_palace_down_right){
-                check_possible_move_and_insert(cb, moves, r, c, r, c + 1);
+            if (empty != 0) {
+                fen += static_cast<char>('0' + empty);
             }
 
-            if (c - 1 >= Board::nine_palace_down_left){
-                check_possible_move_and_insert(cb, moves, r, c, r, c - 1);
+            if (r != row_end) {
+                fen += '/';
             }
+        }
+
+        fen += sideToMove == Side::up ? " b" : " w";
+        return fen;
+    }
 
-            for (row = r - 1; row >= Board::row_begin ;--row){
-                p = cb.get(row, c);
+    void make(const Move& mv) = delete;
 
-                if (p == P_EE){
-                    continue;
-                }
-                else if (p == P_UG){
-                    moves.emplace_back(r, c, row, c);
-                    break;
-                }
-                else {
-                    break;
-                }
-            }
-        }
+    void move(const Move& mv) {
+        Piece fp = get(mv.from);
+        Piece tp = get(mv.to);
+
+        history.emplace_back(mv, fp, tp);
+
+        update_attacks(mv.from, mv.to, [&]() {
+            set(mv.from, P_EE);
+            set(mv.to, fp);
+        });
+        update_hash(mv, fp, tp);
+        materialScore += material_delta(mv, fp, tp);
     }
-public:
-    static std::vector<Move> gen_possible_moves(const Board& cb, Side side) {
-        assert(side != Side::extra);
 
-        std::vector<Move> moves;
-        moves.reserve(256);
+    void undo() {
+        if (!history.empty()) {
+            const HistoryNode& hist = history.back();
 
-        Piece p;
-        for (int32_t r = Board::row_begin; r <= Board::row_end; ++r) {
-            for (int32_t c = Board::col_begin; c <= Board::col_end; ++c){
-                p = cb.get(r, c);
+            update_attacks(hist.mv.from, hist.mv.to, [&]() {
+                set(hist.mv.from, hist.fp);
+                set(hist.mv.to, hist.tp);
+            });
+            update_hash(hist.mv, hist.fp, hist.tp);
+            materialScore -= material_delta(hist.mv, hist.fp, hist.tp);
 
-                if (piece_side(p) == side){
-                    switch (piece_type(p))
-                    {
-                    case Type::pawn:
-                        gen_moves_pawn(cb, moves, r, c, side);
-                        break;
-                    case Type::cannon:
-                        gen_moves_cannon(cb, moves, r, c, side);
-                        break;
+            history.pop_back();
+        }
+    }
+};
+
+// moves are written like "b2e2", files a to i from left to right, ranks 0 to 9 from bottom to top.
+class Notation {
+public:
+    static bool is_move(const std::string& input) {
+        if (input.size() < 4){
+            return false;
+        }
+
+        return  (input[0] >= 'a' && input[0] <= 'i') &&
+                (input[1] >= '0' && input[1] <= '9') &&
+                (input[2] >= 'a' && input[2] <= 'i') &&
+                (input[3] >= '0' && input[3] <= '9');
+    }
+
+    static Move to_move(const std::string& input) {
+        Move mv;
+
+        mv.from.row = Board::row_begin + 9 - (input[1] - '0');
+        mv.from.col = Board::col_begin + (input[0] - 'a');
+        mv.to.row   = Board::row_begin + 9 - (input[3] - '0');
+        mv.to.col   = Board::col_begin + (input[2] - 'a');
+
+        return mv;
+    }
+
+    static std::string desc(const Move& mv) {
+        std::string buf;
+
+        buf += static_cast<char>(mv.from.col - Board::col_begin + 'a');
+        buf += static_cast<char>(9 - (mv.from.row - Board::row_begin) + '0');
+        buf += static_cast<char>(mv.to.col - Board::col_begin + 'a');
+        buf += static_cast<char>(9 - (mv.to.row - Board::row_begin) + '0');
+        return buf;
+    }
+};
+
+class MovesGen {
+    // squares only become rows and columns here, where a move is made of them.
+    static void add_move(std::vector<Move>& moves, int32_t from, int32_t to) {
+        moves.emplace_back(Board::to_pos(from), Board::to_pos(to));
+    }
+
+    static void check_possible_move_and_insert(const Position& cb, std::vector<Move>& moves, int32_t from, int32_t to, Side side) {
+        Piece p = cb.at(to);
+
+        if (p != P_EO && piece_side(p) != side) {   // not out of chess board, and not the same side.
+            add_move(moves, from, to);
+        }
+    }
+
+    static void gen_moves_pawn(const Position& cb, std::vector<Move>& moves, int32_t from, Side side) {
+        bool up = side == Side::up;
+        check_possible_move_and_insert(cb, moves, from, from + (up ? Board::step_down : Board::step_up), side);
+
+        if (up ? Board::row_of(from) > Board::river_up : Board::row_of(from) < Board::river_down) {    // cross the river ?
+            check_possible_move_and_insert(cb, moves, from, from + Board::step_left, side);
+            check_possible_move_and_insert(cb, moves, from, from + Board::step_right, side);
+        }
+    }
+
+    static void gen_moves_cannon_one_direction(const Position& cb, std::vector<Move>& moves, int32_t from, int32_t step, Side side) {
+        int32_t to = from + step;
+
+        while (cb.at(to) == P_EE) {    // empty piece, then insert it.
+            add_move(moves, from, to);
+            to += step;
+        }
+
+        if (cb.at(to) == P_EO) {    // out of chess board, nothing to jump over.
+            return;
+        }
+
+        to += step;
+        while (cb.at(to) == P_EE) {
+            to += step;
+        }
+
+        if (piece_side(cb.at(to)) == piece_side_reverse(side)) {   // enemy piece behind the screen, then insert it.
+            add_move(moves, from, to);
+        }
+    }
+
+    static void gen_moves_cannon(const Position& cb, std::vector<Move>& moves, int32_t from, Side side) {
+        for (int32_t step : Board::rays) {
+            gen_moves_cannon_one_direction(cb, moves, from, step, side);
+        }
+    }
+
+    static void gen_moves_rook_one_direction(const Position& cb, std::vector<Move>& moves, int32_t from, int32_t step, Side side) {
+        int32_t to = from + step;
+
+        while (cb.at(to) == P_EE) {    // empty piece, then insert it.
+            add_move(moves, from, to);
+            to += step;
+        }
+
+        if (piece_side(cb.at(to)) == piece_side_reverse(side)) {   // enemy piece, then insert it.
+            add_move(moves, from, to);
+        }
+    }
+
+    static void gen_moves_rook(const Position& cb, std::vector<Move>& moves, int32_t from, Side side) {
+        for (int32_t step : Board::rays) {
+            gen_moves_rook_one_direction(cb, moves, from, step, side);
+        }
+    }
+
+    static void gen_moves_knight(const Position& cb, std::vector<Move>& moves, int32_t from, Side side) {
+        for (const auto& k : Board::knight_moves) {
+            if (cb.at(from + k[1]) == P_EE) {    // if not lame horse leg ?
+                check_possible_move_and_insert(cb, moves, from, from + k[0], side);
+            }
+        }
+    }
+
+    static void gen_moves_bishop(const Position& cb, std::vector<Move>& moves, int32_t from, Side side) {
+        int32_t forward = side == Side::up ? Board::step_down : Board::step_up;
+        int32_t ahead = Board::row_of(from + 2 * forward);
+
+        // bishop can move only if Xiang Yan is empty.
+        auto step = [&](int32_t eye) {
+            if (cb.at(from + eye) == P_EE) {
+                check_possible_move_and_insert(cb, moves, from, from + 2 * eye, side);
+            }
+        };
+
+        if (side == Side::up ? ahead <= Board::river_up : ahead >= Board::river_down) {    // bishop can't cross river.
+            step(forward + Board::step_right);
+            step(forward + Board::step_left);
+        }
+
+        step(-forward + Board::step_right);
+        step(-forward + Board::step_left);
+    }
+
+    static void gen_moves_advisor(const Position& cb, std::vector<Move>& moves, int32_t from, Side side) {
+        // walk diagonal lines.
+        for (int32_t d : { Board::step_down + Board::step_right, Board::step_down + Board::step_left, Board::step_up + Board::step_right, Board::step_up + Board::step_left }) {
+            if (Board::in_palace(from + d, side)) {
+                check_possible_move_and_insert(cb, moves, from, from + d, side);
+            }
+        }
+    }
+
+    static void gen_moves_general(const Position& cb, std::vector<Move>& moves, int32_t from, Side side) {
+        // walk horizontal or vertical.
+        for (int32_t d : { Board::step_down, Board::step_up, Board::step_right, Board::step_left }) {
+            if (Board::in_palace(from + d, side)) {
+                check_possible_move_and_insert(cb, moves, from, from + d, side);
+            }
+        }
+
+        // check if both generals faced each other directly.
+        int32_t toward = side == Side::up ? Board::step_down : Board::step_up;
+        int32_t to = from + toward;
+
+        while (cb.at(to) == P_EE) {
+            to += toward;
+        }
+
+        if (cb.at(to) == make_piece(piece_side_reverse(side), Type::general)) {
+            add_move(moves, from, to);
+        }
+    }
+public:
+    static std::vector<Move> gen_possible_moves(const Position& cb, Side side) {
+        std::vector<Move> moves;
+        moves.reserve(256);
+
+        gen_possible_moves(cb, side, moves);
+        return moves;
+    }
+
+    // appends to moves, so a search can keep one list per ply and never allocate again.
+    static void gen_possible_moves(const Position& cb, Side side, std::vector<Move>& moves) {
+        assert(side != Side::extra);
+
+        for (int32_t r = Board::row_begin; r <= Board::row_end; ++r) {
+            for (int32_t sq = Board::square(r, Board::col_begin); sq <= Board::square(r, Board::col_end); ++sq) {
+                Piece p = cb.at(sq);
+
+                if (piece_side(p) == side){
+                    switch (piece_type(p))
+                    {
+                    case Type::pawn:
+                        gen_moves_pawn(cb, moves, sq, side);
+                        break;
+                    case Type::cannon:
+                        gen_moves_cannon(cb, moves, sq, side);
+                        break;
                     case Type::rook:
-                        gen_moves_rook(cb, moves, r, c, side);
+                        gen_moves_rook(cb, moves, sq, side);
                         break;
                     case Type::knight:
-                        gen_moves_knight(cb, moves, r, c, side);
+                        gen_moves_knight(cb, moves, sq, side);
                         break;
                     case Type::bishop:
-                        gen_moves_bishop(cb, moves, r, c, side);
+                        gen_moves_bishop(cb, moves, sq, side);
                         break;
                     case Type::advisor:
-                        gen_moves_advisor(cb, moves, r, c, side);
+                        gen_moves_advisor(cb, moves, sq, side);
                         break;
                     case Type::general:
-                        gen_moves_general(cb, moves, r, c, side);
+                        gen_moves_general(cb, moves, sq, side);
                         break;
                     default:
                         break;
@@ -575,16 +1034,372 @@ public:
                 }
             }
         }
+    }
+
+    // whether gen_possible_moves would give mv for side, from the rules of the moving piece alone: a clear
+    // line for rooks, exactly one screen for cannon captures, a free leg for knights and bishops, and so on.
+    // moves that did not come from the generator, typed in or read from the table, are checked with it.
+    static bool is_pseudo_legal(const Position& cb, Side side, const Move& mv) {
+        auto on_board = [](Pos pos) {
+            return pos.row >= Board::row_begin && pos.row <= Board::row_end && pos.col >= Board::col_begin && pos.col <= Board::col_end;
+        };
+
+        if (!on_board(mv.from) || !on_board(mv.to)) {
+            return false;
+        }
+
+        Piece moving = cb.get(mv.from);
+        Piece target = cb.get(mv.to);
+
+        if (piece_side(moving) != side || piece_side(target) == side) {
+            return false;
+        }
+
+        int32_t dr = mv.to.row - mv.from.row;
+        int32_t dc = mv.to.col - mv.from.col;
+        int32_t forward = side == Side::up ? +1 : -1;
+        bool up = side == Side::up;
+
+        auto in_palace = [up](Pos pos) {
+            int32_t top = up ? Board::nine_palace_up_top : Board::nine_palace_down_top;
+            int32_t bottom = up ? Board::nine_palace_up_bottom : Board::nine_palace_down_bottom;
+            return pos.row >= top && pos.row <= bottom && pos.col >= Board::nine_palace_up_left && pos.col <= Board::nine_palace_up_right;
+        };
+
+        switch (piece_type(moving)) {
+        case Type::pawn: {
+            bool crossed = up ? mv.from.row > Board::river_up : mv.from.row < Board::river_down;
+            return (dr == forward && dc == 0) || (crossed && dr == 0 && std::abs(dc) == 1);
+        }
+        case Type::rook:
+        case Type::cannon: {
+            if ((dr == 0) == (dc == 0)) {
+                return false;
+            }
+
+            int32_t screens = count_between(cb, mv.from, mv.to);
+            if (piece_type(moving) == Type::rook || target == P_EE) {
+                return screens == 0;
+            }
+
+            return screens == 1;
+        }
+        case Type::knight: {
+            if (!(std::abs(dr) == 2 && std::abs(dc) == 1) && !(std::abs(dr) == 1 && std::abs(dc) == 2)) {
+                return false;
+            }
+
+            Pos leg = std::abs(dr) == 2 ? Pos{ mv.from.row + dr / 2, mv.from.col } : Pos{ mv.from.row, mv.from.col + dc / 2 };
+            return cb.get(leg) == P_EE;
+        }
+        case Type::bishop: {
+            if (std::abs(dr) != 2 || std::abs(dc) != 2) {
+                return false;
+            }
+
+            // only a step towards the river can cross it.
+            bool ownHalf = up ? mv.to.row <= Board::river_up : mv.to.row >= Board::river_down;
+            return (dr != 2 * forward || ownHalf) && cb.get(mv.from.row + dr / 2, mv.from.col + dc / 2) == P_EE;
+        }
+        case Type::advisor:
+            return std::abs(dr) == 1 && std::abs(dc) == 1 && in_palace(mv.to);
+        case Type::general:
+            if (std::abs(dr) + std::abs(dc) == 1) {
+                return in_palace(mv.to);
+            }
+
+            // taking the other general straight across the board.
+            return dc == 0 && (dr > 0) == up && piece_type(target) == Type::general && count_between(cb, mv.from, mv.to) == 0;
+        default:
+            return false;
+        }
+    }
+
+    // pieces strictly between two squares on the same rank or file.
+    static int32_t count_between(const Position& cb, Pos from, Pos to) {
+        int32_t step = from.row == to.row ? (to.col > from.col ? Board::step_right : Board::step_left)
+                                          : (to.row > from.row ? Board::step_down : Board::step_up);
+        int32_t count = 0;
+
+        for (int32_t sq = Board::square(from) + step, end = Board::square(to); sq != end; sq += step) {
+            count += cb.at(sq) != P_EE;
+        }
+
+        return count;
+    }
+
+    // a knight square seen from the square it attacks, and the leg next to the attacked square.
+    static constexpr int32_t knight_attacks[8][2] = {
+        { 2 * Board::step_up + Board::step_left, Board::step_up + Board::step_left },
+        { 2 * Board::step_up + Board::step_right, Board::step_up + Board::step_right },
+        { 2 * Board::step_down + Board::step_left, Board::step_down + Board::step_left },
+        { 2 * Board::step_down + Board::step_right, Board::step_down + Board::step_right },
+        { Board::step_up + 2 * Board::step_left, Board::step_up + Board::step_left },
+        { Board::step_down + 2 * Board::step_left, Board::step_down + Board::step_left },
+        { Board::step_up + 2 * Board::step_right, Board::step_up + Board::step_right },
+        { Board::step_down + 2 * Board::step_right, Board::step_down + Board::step_right },
+    };
+
+    // looks outwards from the general instead of generating every enemy move.
+    // advisors and bishops never leave their own half, so they cannot reach the other general.
+    // at(sq) gives the piece on a square, so the board can be looked at as if a move was made.
+    template<typename Lookup>
+    static bool is_general_attacked(Pos general, Side side, Lookup&& at) {
+        int32_t from = Board::square(general);
+        Side enemy = piece_side_reverse(side);
+        Piece rook = make_piece(enemy, Type::rook);
+        Piece cannon = make_piece(enemy, Type::cannon);
+        Piece knight = make_piece(enemy, Type::knight);
+        Piece pawn = make_piece(enemy, Type::pawn);
+        Piece enemyGeneral = make_piece(enemy, Type::general);
+
+        for (int32_t step : Board::rays) {
+            int32_t screens = 0;
+
+            for (int32_t sq = from + step; ; sq += step) {
+                Piece p = at(sq);
+
+                if (p == P_EE) {
+                    continue;
+                }
+
+                if (p == P_EO) {
+                    break;
+                }
+
+                bool vertical = step == Board::step_up || step == Board::step_down;
+                if (screens == 0 && (p == rook || (p == enemyGeneral && vertical))) {
+                    return true;
+                }
+
+                if (screens == 1) {
+                    if (p == cannon) {
+                        return true;
+                    }
+
+                    break;
+                }
+
+                ++screens;
+            }
+        }
+
+        // a knight two rows and one column away is blocked by the piece next to it towards the general.
+        for (const auto& k : knight_attacks) {
+            if (at(from + k[0]) == knight && at(from + k[1]) == P_EE) {
+                return true;
+            }
+        }
+
+        // upper pawns walk downwards, and sideways once they crossed the river.
+        int32_t forward = enemy == Side::up ? Board::step_up : Board::step_down;
+        if (at(from + forward) == pawn) {
+            return true;
+        }
+
+        bool crossed = enemy == Side::up ? general.row > Board::river_up : general.row < Board::river_down;
+        return crossed && (at(from + Board::step_left) == pawn || at(from + Board::step_right) == pawn);
+    }
+
+    static bool is_general_attacked(const Position& cb, Pos general, Side side) {
+        return is_general_attacked(general, side, [&cb](int32_t sq) { return cb.at(sq); });
+    }
+
+    // whether mv leaves the other general attacked, without making it. the general is looked at from as if
+    // mv.from was empty and the moving piece stood on mv.to, which covers direct checks, rooks and cannons
+    // uncovered behind the moving piece, cannon screens put in or taken away, knight legs cleared and
+    // generals left facing each other.
+    // the other general must not be in check already, which holds after any legal move.
+    static bool gives_check(const Position& cb, const Move& mv) {
+        Piece moving = cb.get(mv.from);
+        Side enemy = piece_side_reverse(piece_side(moving));
+        Pos general = cb.find_general(enemy);
+
+        if (general == Pos{} || mv.to == general) {
+            return false;
+        }
+
+        // a new attack comes from the moving piece or through one of the two squares, so one of them has to
+        // share a rank or file with the general, or be close enough for a knight, its leg or a pawn.
+        auto related = [general](Pos pos) {
+            return pos.row == general.row || pos.col == general.col || (std::abs(pos.row - general.row) <= 2 && std::abs(pos.col - general.col) <= 2);
+        };
+
+        if (!related(mv.from) && !related(mv.to)) {
+            return false;
+        }
+
+        int32_t from = Board::square(mv.from);
+        int32_t to = Board::square(mv.to);
+
+        return is_general_attacked(general, enemy, [&](int32_t sq) {
+            if (sq == to) {
+                return moving;
+            }
+
+            if (sq == from) {
+                return P_EE;
+            }
+
+            return cb.at(sq);
+        });
+    }
+
+    // calls visit(pos) for every piece of side that can capture on target right now.
+    // generals facing each other are left out, only the search ever plays that capture.
+    template<typename Visit>
+    static void for_each_attacker(const Position& cb, Pos target, Side side, Visit&& visit) {
+        Piece rook = make_piece(side, Type::rook);
+        Piece cannon = make_piece(side, Type::cannon);
+        Piece knight = make_piece(side, Type::knight);
+        Piece bishop = make_piece(side, Type::bishop);
+        Piece advisor = make_piece(side, Type::advisor);
+        Piece pawn = make_piece(side, Type::pawn);
+        Piece general = make_piece(side, Type::general);
+
+        int32_t palaceTop = side == Side::up ? Board::nine_palace_up_top : Board::nine_palace_down_top;
+        int32_t palaceBottom = side == Side::up ? Board::nine_palace_up_bottom : Board::nine_palace_down_bottom;
+        bool inPalace = target.row >= palaceTop && target.row <= palaceBottom &&
+                        target.col >= Board::nine_palace_up_left && target.col <= Board::nine_palace_up_right;
+        bool ownHalf = side == Side::up ? target.row <= Board::river_up : target.row >= Board::river_down;
+        int32_t to = Board::square(target);
+
+        for (int32_t step : Board::rays) {
+            int32_t screens = 0;
+
+            for (int32_t sq = to + step; ; sq += step) {
+                Piece p = cb.at(sq);
+
+                if (p == P_EE) {
+                    continue;
+                }
+
+                if (p == P_EO) {
+                    break;
+                }
+
+                bool adjacent = sq == to + step;
+                if (screens == 0 && (p == rook || (p == general && adjacent && inPalace))) {
+                    visit(Board::to_pos(sq));
+                }
+
+                if (screens == 1) {
+                    if (p == cannon) {
+                        visit(Board::to_pos(sq));
+                    }
+
+                    break;
+                }
+
+                ++screens;
+            }
+        }
+
+        for (const auto& k : knight_attacks) {
+            if (cb.at(to + k[0]) == knight && cb.at(to + k[1]) == P_EE) {
+                visit(Board::to_pos(to + k[0]));
+            }
+        }
+
+        for (int32_t d : Board::diagonals) {
+            if (inPalace && cb.at(to + d) == advisor) {
+                visit(Board::to_pos(to + d));
+            }
+
+            if (ownHalf && cb.at(to + 2 * d) == bishop && cb.at(to + d) == P_EE) {
+                visit(Board::to_pos(to + 2 * d));
+            }
+        }
+
+        // upper pawns walk downwards, and sideways once they crossed the river.
+        int32_t forward = side == Side::up ? Board::step_down : Board::step_up;
+        if (cb.at(to - forward) == pawn) {
+            visit(Board::to_pos(to - forward));
+        }
+
+        bool crossed = side == Side::up ? target.row > Board::river_up : target.row < Board::river_down;
+        for (int32_t step : { Board::step_left, Board::step_right }) {
+            if (crossed && cb.at(to + step) == pawn) {
+                visit(Board::to_pos(to + step));
+            }
+        }
+    }
+
+    // whether side's general can be taken by the other side right now, facing generals included.
+    // a side without general is always in check. perft and legal move generation ask this once per move,
+    // so it looks outward from the general instead of generating every move of the other side.
+    static bool is_in_check(const Position& cb, Side side) {
+        assert(side != Side::extra);
+
+        Pos general = cb.find_general(side);
+        return general == Pos{} || is_general_attacked(cb, general, side);
+    }
+
+    // the same, read from the attack maps when the board keeps them.
+    static bool is_in_check(const Board& cb, Side side) {
+        assert(side != Side::extra);
+
+        if (!cb.tracks_attacks()) {
+            return is_in_check(static_cast<const Position&>(cb), side);
+        }
+
+        Pos general = cb.find_general(side);
+        return general == Pos{} || cb.attackers(piece_side_reverse(side), general) != 0;
+    }
+
+    // counts the legal moves without collecting them, for perft leaves.
+    static uint64_t count_legal_moves(Board& cb, Side side) {
+        uint64_t count = 0;
+
+        for (const Move& mv : gen_possible_moves(cb, side)) {
+            cb.move(mv);
+            count += !is_in_check(cb, side);
+            cb.undo();
+        }
+
+        return count;
+    }
 
+    // pseudo legal moves which do not leave the own general in check.
+    static std::vector<Move> gen_legal_moves(Board& cb, Side side) {
+        auto moves = gen_possible_moves(cb, side);
+
+        auto it = std::remove_if(moves.begin(), moves.end(), [&cb, side](const Move& mv) {
+            cb.move(mv);
+            bool illegal = is_in_check(cb, side);
+            cb.undo();
+            return illegal;
+        });
+
+        moves.erase(it, moves.end());
         return moves;
     }
+
+    // appends the captures to moves.
+    static void gen_captures(const Position& cb, Side side, std::vector<Move>& moves) {
+        size_t first = moves.size();
+        gen_possible_moves(cb, side, moves);
+
+        auto it = std::remove_if(moves.begin() + first, moves.end(), [&cb](const Move& mv) { return cb.get(mv.to) == P_EE; });
+        moves.erase(it, moves.end());
+    }
 };
 
 using PosValue = std::array<std::array<int32_t, Board::real_col_num>, Board::real_row_num>;
 static std::map<Piece, int32_t> piece_value_mapping;
 static std::map<Piece, PosValue> piece_pos_value_mapping;
+static std::array<int32_t, 14> piece_material_mapping;        // absolute piece values by piece_index.
 
 class ScoreEvaluator {
+    static constexpr int32_t mobility_weight = 1;
+    static constexpr int32_t king_safety_weight = 4;
+
+    // mobility and king safety together never move the score further than lazy_margin.
+    static constexpr int32_t lazy_margin = 50;
+
+    // set once before any search starts.
+    static inline bool positional_terms = false;
+    static inline bool lazy = true;
     static void init_single_piece_value(Piece p, std::ifstream& in) {
         int32_t value;
         in >> value;
@@ -594,6 +1409,7 @@ class ScoreEvaluator {
         }
 
         piece_value_mapping[p] = value;
+        piece_material_mapping[piece_index(p)] = std::abs(value);
     }
 
     static void init_piece_value(const std::string& path) {
@@ -638,412 +1454,2492 @@ class ScoreEvaluator {
         }
 
         piece_pos_value_mapping[p] = posValue;
-    }
-public:
-    static void init_values() {
-        init_piece_value("piece_value.txt");
-
-        init_piece_pos_value(P_UP, "piece_pos_value_up_pawn.txt");
-        init_piece_pos_value(P_UC, "piece_pos_value_up_cannon.txt");
-        init_piece_pos_value(P_UR, "piece_pos_value_up_rook.txt");
-        init_piece_pos_value(P_UN, "piece_pos_value_up_knight.txt");
-        init_piece_pos_value(P_UB, "piece_pos_value_up_bishop.txt");
-        init_piece_pos_value(P_UA, "piece_pos_value_up_advisor.txt");
-        init_piece_pos_value(P_UG, "piece_pos_value_up_general.txt");
-
-        init_piece_pos_value(P_DP, "piece_pos_value_down_pawn.txt");
-        init_piece_pos_value(P_DC, "piece_pos_value_down_cannon.txt");
-        init_piece_pos_value(P_DR, "piece_pos_value_down_rook.txt");
-        init_piece_pos_value(P_DN, "piece_pos_value_down_knight.txt");
-        init_piece_pos_value(P_DB, "piece_pos_value_down_bishop.txt");
-        init_piece_pos_value(P_DA, "piece_pos_value_down_advisor.txt");
-        init_piece_pos_value(P_DG, "piece_pos_value_down_general.txt");
-    }
-
-    // upper is negative, down is positive.
-    static int32_t evaluate(const Board& board) {
-        int32_t totalScore = 0;
 
         for (int32_t r = Board::row_begin; r <= Board::row_end; ++r) {
             for (int32_t c = Board::col_begin; c <= Board::col_end; ++c) {
-                Piece p = board.get(r, c);
-
-                if (p != P_EE) {
-                    totalScore += piece_value_mapping[p];
-                    totalScore += piece_pos_value_mapping[p][r - Board::row_begin][c - Board::col_begin];
-                }
+                Board::set_square_value(p, Pos{ r, c }, piece_value_mapping[p] + posValue[r - Board::row_begin][c - Board::col_begin]);
             }
         }
+    }
 
-        return totalScore;
+    // more legal looking moves than the other side is worth mobility_weight each.
+    static int32_t mobility(const Position& board) {
+        int32_t down = static_cast<int32_t>(MovesGen::gen_possible_moves(board, Side::down).size());
+        int32_t up = static_cast<int32_t>(MovesGen::gen_possible_moves(board, Side::up).size());
+        return (down - up) * mobility_weight;
     }
-};
 
-class BestMoveGen {
-    // the bigger the score it is, the better for down side.
-    static int32_t min_max(Board& board, uint32_t searchDepth, int32_t alpha, int32_t beta, bool isMax) {
-        if (searchDepth == 0) {
-            return ScoreEvaluator::evaluate(board);
-        }
+    // every attack on a general or the palace squares next to it costs king_safety_weight.
+    static int32_t king_safety(const Position& board) {
+        int32_t score = 0;
 
-        if (isMax) {
-            int32_t maxValue = std::numeric_limits<int32_t>::min();
-            auto moves = MovesGen::gen_possible_moves(board, Side::down);
-
-            for (const Move& mv : moves) {
-                board.move(mv);
-                maxValue = std::max(maxValue, min_max(board, searchDepth - 1, alpha, beta, !isMax));
-                board.undo();
-
-                alpha = std::max(alpha, maxValue);
-                if (alpha >= beta) {
-                    break;
-                }
+        for (Side s : { Side::down, Side::up }) {
+            Pos general = board.find_general(s);
+            if (general == Pos{}) {
+                continue;
             }
 
-            return maxValue;
-        }
-        else {
-            int32_t minValue = std::numeric_limits<int32_t>::max();
-            auto moves = MovesGen::gen_possible_moves(board, Side::up);
+            int32_t top = s == Side::up ? Board::nine_palace_up_top : Board::nine_palace_down_top;
+            int32_t bottom = s == Side::up ? Board::nine_palace_up_bottom : Board::nine_palace_down_bottom;
+            int32_t attacks = 0;
 
-            for (const Move& mv : moves) {
-                board.move(mv);
-                minValue = std::min(minValue, min_max(board, searchDepth - 1, alpha, beta, !isMax));
-                board.undo();
+            static constexpr int32_t around[5][2] = { { 0, 0 }, { -1, 0 }, { +1, 0 }, { 0, -1 }, { 0, +1 } };
+            for (const auto& d : around) {
+                Pos pos{ general.row + d[0], general.col + d[1] };
 
-                beta = std::min(beta, minValue);
-                if (alpha >= beta) {
-                    break;
+                if (pos.row >= top && pos.row <= bottom && pos.col >= Board::nine_palace_up_left && pos.col <= Board::nine_palace_up_right) {
+                    MovesGen::for_each_attacker(board, pos, piece_side_reverse(s), [&attacks](Pos) { ++attacks; });
                 }
             }
 
-            return minValue;
+            score += (s == Side::down ? -attacks : attacks) * king_safety_weight;
         }
+
+        return score;
     }
 public:
-    static Move gen(Board& board, Side s, uint32_t searchDepth) {
-        assert(s != Side::extra);
-
-        int32_t alpha = std::numeric_limits<int32_t>::min();
-        int32_t beta = std::numeric_limits<int32_t>::max();
-        Move bestMove;
+    // dir holds piece_value.txt and the piece_pos_value_*.txt tables.
+    static void init_values(const std::string& dir) {
+        auto file = [&dir](const char* name) { return dir.empty() ? std::string{ name } : dir + "/" + name; };
+
+        init_piece_value(file("piece_value.txt"));
+
+        init_piece_pos_value(P_UP, file("piece_pos_value_up_pawn.txt"));
+        init_piece_pos_value(P_UC, file("piece_pos_value_up_cannon.txt"));
+        init_piece_pos_value(P_UR, file("piece_pos_value_up_rook.txt"));
+        init_piece_pos_value(P_UN, file("piece_pos_value_up_knight.txt"));
+        init_piece_pos_value(P_UB, file("piece_pos_value_up_bishop.txt"));
+        init_piece_pos_value(P_UA, file("piece_pos_value_up_advisor.txt"));
+        init_piece_pos_value(P_UG, file("piece_pos_value_up_general.txt"));
+
+        init_piece_pos_value(P_DP, file("piece_pos_value_down_pawn.txt"));
+        init_piece_pos_value(P_DC, file("piece_pos_value_down_cannon.txt"));
+        init_piece_pos_value(P_DR, file("piece_pos_value_down_rook.txt"));
+        init_piece_pos_value(P_DN, file("piece_pos_value_down_knight.txt"));
+        init_piece_pos_value(P_DB, file("piece_pos_value_down_bishop.txt"));
+        init_piece_pos_value(P_DA, file("piece_pos_value_down_advisor.txt"));
+        init_piece_pos_value(P_DG, file("piece_pos_value_down_general.txt"));
+    }
 
-        if (s == Side::up) {
-            int32_t minValue = std::numeric_limits<int32_t>::max();
-            auto moves = MovesGen::gen_possible_moves(board, Side::up);
+    // what a piece is worth to either side, 0 for an empty square.
+    static int32_t material(Piece p) noexcept {
+        int32_t index = piece_index(p);
+        return index < 0 ? 0 : piece_material_mapping[index];
+    }
 
-            for (const Move& mv : moves) {
-                board.move(mv);
-                int32_t temp = min_max(board, searchDepth, alpha, beta, true);
-                board.undo();
+    // positionalTerms adds mobility and king safety to material, lazy lets evaluate skip them when they
+    // cannot matter.
+    static void configure(bool positionalTerms, bool lazyEval) noexcept {
+        positional_terms = positionalTerms;
+        lazy = lazyEval;
+    }
 
-                if (temp <= minValue) {
-                    minValue = temp;
-                    bestMove = mv;
-                }
-            }
+    // upper is negative, down is positive.
+    // material comes from the board for free. the other terms are only worked out when they can still bring
+    // the score into the window (alpha, beta), they are capped at lazy_margin. a lazy score is the bound the
+    // full one cannot pass, material plus lazy_margin below the window and minus it above, so it stays sound
+    // as a stand pat value and as a table bound.
+    static int32_t evaluate(const Position& board, int32_t alpha, int32_t beta) {
+        int32_t score = board.material_score();
+
+        if (!positional_terms) {
+            return score;
         }
-        else {
-            int32_t maxValue = std::numeric_limits<int32_t>::min();
-            auto moves = MovesGen::gen_possible_moves(board, Side::down);
 
-            for (const Move& mv : moves) {
-                board.move(mv);
-                int32_t temp = min_max(board, searchDepth, alpha, beta, false);
-                board.undo();
+        if (lazy && score + lazy_margin <= alpha) {
+            return score + lazy_margin;
+        }
 
-                if (temp >= maxValue) {
-                    maxValue = temp;
-                    bestMove = mv;
-                }
-            }
+        if (lazy && score - lazy_margin >= beta) {
+            return score - lazy_margin;
         }
 
-        return bestMove;
+        return score + std::clamp(mobility(board) + king_safety(board), -lazy_margin, lazy_margin);
+    }
+
+    // how far the terms on top of material can move the score, so material plus or minus this bounds it
+    // whether or not they were worked out.
+    static int32_t positional_margin() noexcept {
+        return positional_terms ? lazy_margin : 0;
+    }
+
+    static int32_t evaluate(const Position& board) {
+        return evaluate(board, std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max());
     }
 };
 
-class BestMoveGenParallel {
-    static constexpr int32_t split_chunk_num = 32;
+// hardware counters of the calling thread and the threads it starts while counting, through perf_event_open.
+// only linux is supported. a counter the kernel or the cpu does not offer reads as -1.
+class PerfCounters {
+public:
+    static constexpr size_t counter_num = 5;
+    static constexpr const char* names[counter_num] = { "cycles", "instructions", "l1d-misses", "llc-misses", "branch-misses" };
 
-    static std::vector<std::span<const Move>> 
-    split_vector(const std::vector<Move>& vec, size_t chunkNum) {
-        std::vector<std::span<const Move>> result;
+    using Values = std::array<int64_t, counter_num>;
+private:
+    std::array<int, counter_num> fds;
+    std::string error;
+
+#ifdef __linux__
+    static int open_counter(uint32_t type, uint64_t config) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+#endif
+public:
+    PerfCounters() {
+        fds.fill(-1);
+
+#ifdef __linux__
+        static constexpr uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const std::pair<uint32_t, uint64_t> events[counter_num] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HW_CACHE, l1d_read_miss },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        };
+
+        for (size_t i = 0; i < counter_num; ++i) {
+            fds[i] = open_counter(events[i].first, events[i].second);
 
-        size_t chunkLength = vec.size() / chunkNum;
-        if (chunkLength == 0) {
-            chunkNum = vec.size();
-            chunkLength = 1;
+            if (fds[i] < 0 && error.empty()) {
+                error = std::string{ names[i] } + ": " + std::strerror(errno);
+            }
         }
-        
-        size_t counter;
-        for (counter = 0; counter != chunkNum - 1; ++counter) {
-            result.emplace_back(vec.begin() + counter * chunkLength, chunkLength);
+#else
+        error = "hardware counters are only supported on linux";
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
         }
+#endif
+    }
 
-        result.emplace_back(vec.begin() + counter * chunkLength, vec.end());
-        return result;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const noexcept {
+        return std::any_of(fds.begin(), fds.end(), [](int fd) { return fd >= 0; });
     }
 
-    // the bigger the score it is, the better for down side.
-    static int32_t min_max(Board& board, uint32_t searchDepth, int32_t alpha, int32_t beta, bool isMax) {
-        if (searchDepth == 0) {
-            return ScoreEvaluator::evaluate(board);
+    // why the first counter that failed could not be opened, empty if all of them could.
+    const std::string& last_error() const noexcept {
+        return error;
+    }
+
+    void start() noexcept {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
         }
+#endif
+    }
 
-        if (isMax) {
-            int32_t maxValue = std::numeric_limits<int32_t>::min();
-            auto moves = MovesGen::gen_possible_moves(board, Side::down);
+    // counts since start, scaled up when the kernel had to share the hardware between counters.
+    // threads started in between only count once they are joined.
+    Values stop() noexcept {
+        Values values;
+        values.fill(-1);
 
-            for (const Move& mv : moves) {
-                board.move(mv);
-                maxValue = std::max(maxValue, min_max(board, searchDepth - 1, alpha, beta, !isMax));
-                board.undo();
+#ifdef __linux__
+        for (size_t i = 0; i < counter_num; ++i) {
+            if (fds[i] < 0) {
+                continue;
+            }
 
-                alpha = std::max(alpha, maxValue);
-                if (alpha >= beta) {
-                    break;
-                }
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            uint64_t data[3];    // value, time enabled, time running.
+            if (read(fds[i], data, sizeof(data)) == static_cast<ssize_t>(sizeof(data)) && data[2] != 0) {
+                values[i] = static_cast<int64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
             }
+        }
+#endif
+
+        return values;
+    }
 
-            return maxValue;
+    // adds up readings of several stretches, a counter that could not be read in one of them stays -1.
+    static void add(Values& total, const Values& values) noexcept {
+        for (size_t i = 0; i < counter_num; ++i) {
+            total[i] = total[i] < 0 || values[i] < 0 ? -1 : total[i] + values[i];
         }
-        else {
-            int32_t minValue = std::numeric_limits<int32_t>::max();
-            auto moves = MovesGen::gen_possible_moves(board, Side::up);
+    }
 
-            for (const Move& mv : moves) {
-                board.move(mv);
-                minValue = std::min(minValue, min_max(board, searchDepth - 1, alpha, beta, !isMax));
-                board.undo();
+    // one line of figures per node, and instructions per cycle.
+    static void show(const std::string& name, const Values& values, uint64_t nodes) {
+        std::cout << std::left << std::setw(12) << name << std::right << " nodes " << nodes << std::fixed << std::setprecision(2);
 
-                beta = std::min(beta, minValue);
-                if (alpha >= beta) {
-                    break;
-                }
+        for (size_t i = 0; i < counter_num; ++i) {
+            std::cout << " " << names[i] << " ";
+
+            if (values[i] < 0) {
+                std::cout << "n/a";
             }
+            else {
+                std::cout << static_cast<double>(values[i]) / std::max<uint64_t>(nodes, 1);
+            }
+        }
 
-            return minValue;
+        if (values[0] > 0 && values[1] >= 0) {
+            std::cout << " ipc " << static_cast<double>(values[1]) / values[0];
         }
+
+        std::cout << " (per node)\n";
+        std::cout.unsetf(std::ios::fixed);
     }
-public:
-    static Move gen(Board& board, Side s, uint32_t searchDepth) {
-        assert(s != Side::extra);
+};
 
-        if (s == Side::up) {
-            auto moves = MovesGen::gen_possible_moves(board, Side::up);
-            auto splitMoves = split_vector(moves, split_chunk_num);
-            
-            std::vector<Move> bestMoves;
-            std::vector<int32_t> bestValues;
-            std::vector<std::future<void>> tasks;
-
-            bestMoves.resize(splitMoves.size());
-            bestValues.resize(splitMoves.size());
-            tasks.resize(splitMoves.size());
-
-            for (size_t i = 0; i < splitMoves.size(); ++i) {
-                tasks[i] = std::async([&board, &bestMoves, &bestValues, &splitMoves, i, searchDepth]() {
-                    Board tempBoard = board;
-                    
-                    int32_t minValue = std::numeric_limits<int32_t>::max();
-                    int32_t alpha = std::numeric_limits<int32_t>::min();
-                    int32_t beta = std::numeric_limits<int32_t>::max();
-                    Move bestMove;
-
-                    for (const Move& mv : splitMoves[i]) {
-                        tempBoard.move(mv);
-                        int32_t val = min_max(tempBoard, searchDepth, alpha, beta, true);
-                        tempBoard.undo();
-
-                        if (val <= minValue) {
-                            minValue = val;
-                            bestMove = mv;
-                        }
-                    }
+// pins search threads to cpus. only linux is supported, elsewhere threads are left to the scheduler.
+class ThreadAffinity {
+    static int32_t read_sys_number(const std::string& path) {
+        std::ifstream in{ path };
+        int32_t value = -1;
+        in >> value;
+        return value;
+    }
+public:
+    // parses lists like "0-3,8,10-11".
+    static std::vector<int32_t> parse_cpu_list(const std::string& list) {
+        std::vector<int32_t> cpus;
+        std::istringstream in{ list };
+        std::string item;
 
-                    bestMoves[i] = bestMove;
-                    bestValues[i] = minValue;
-                });
-            }
+        while (std::getline(in, item, ',')) {
+            size_t dash = item.find('-');
 
-            for (auto& task : tasks) {
-                task.get();
-            }
+            try {
+                int32_t first = std::stoi(item.substr(0, dash));
+                int32_t last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
 
-            float minVal = std::numeric_limits<int32_t>::max();
-            size_t minIndex;
+                if (first < 0 || last < first) {
+                    throw std::out_of_range{ item };
+                }
 
-            for (size_t i = 0; i < bestValues.size(); ++i) {
-                if (bestValues[i] <= minVal) {
-                    minVal = bestValues[i];
-                    minIndex = i;
+                for (int32_t cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
                 }
             }
+            catch (const std::logic_error&) {
+                throw std::invalid_argument{ "bad cpu list: " + list };
+            }
+        }
+
+        return cpus;
+    }
+
+    // the cpus this process may run on, one per physical core first, then their SMT siblings.
+    static std::vector<int32_t> topology_order() {
+        std::vector<int32_t> cpus;
 
-            return bestMoves[minIndex];
+        #ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            return cpus;
         }
-        else {
-            auto moves = MovesGen::gen_possible_moves(board, Side::down);
-            auto splitMoves = split_vector(moves, split_chunk_num);
-            
-            std::vector<Move> bestMoves;
-            std::vector<int32_t> bestValues;
-            std::vector<std::future<void>> tasks;
-
-            bestMoves.resize(splitMoves.size());
-            bestValues.resize(splitMoves.size());
-            tasks.resize(splitMoves.size());
-
-            for (size_t i = 0; i < splitMoves.size(); ++i) {
-                tasks[i] = std::async([&board, &bestMoves, &bestValues, &splitMoves, i, searchDepth]() {
-                    Board tempBoard = board;
-                    
-                    int32_t maxValue = std::numeric_limits<int32_t>::min();
-                    int32_t alpha = std::numeric_limits<int32_t>::min();
-                    int32_t beta = std::numeric_limits<int32_t>::max();
-                    Move bestMove;
-
-                    for (const Move& mv : splitMoves[i]) {
-                        tempBoard.move(mv);
-                        int32_t val = min_max(tempBoard, searchDepth, alpha, beta, true);
-                        tempBoard.undo();
-
-                        if (val >= maxValue) {
-                            maxValue = val;
-                            bestMove = mv;
-                        }
-                    }
 
-                    bestMoves[i] = bestMove;
-                    bestValues[i] = maxValue;
-                });
+        // (package, core) -> its cpus.
+        std::map<std::pair<int32_t, int32_t>, std::vector<int32_t>> cores;
+
+        for (int32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &allowed)) {
+                continue;
             }
 
-            for (auto& task : tasks) {
-                task.get();
+            std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+            int32_t package = read_sys_number(dir + "physical_package_id");
+            int32_t core = read_sys_number(dir + "core_id");
+
+            if (core < 0) {     // no topology information, treat every cpu as its own core.
+                core = cpu;
             }
 
-            float maxVal = std::numeric_limits<int32_t>::min();
-            size_t maxIndex;
+            cores[{ package, core }].push_back(cpu);
+        }
 
-            for (size_t i = 0; i < bestValues.size(); ++i) {
-                if (bestValues[i] >= maxVal) {
-                    maxVal = bestValues[i];
-                    maxIndex = i;
+        for (size_t sibling = 0; cpus.size() < static_cast<size_t>(CPU_COUNT(&allowed)); ++sibling) {
+            for (const auto& [key, siblings] : cores) {
+                if (sibling < siblings.size()) {
+                    cpus.push_back(siblings[sibling]);
                 }
             }
+        }
+        #endif
+
+        return cpus;
+    }
+
+    // "off" gives no pinning, "auto" the topology order, anything else is a cpu list.
+    static std::vector<int32_t> resolve(const std::string& setting) {
+        if (setting == "off") {
+            return {};
+        }
 
-            return bestMoves[maxIndex];
+        if (setting == "auto") {
+            return topology_order();
         }
+
+        return parse_cpu_list(setting);
+    }
+
+    static bool pin(std::thread& t, int32_t cpu) {
+        #ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(t.native_handle(), sizeof(set), &set) == 0;
+        #else
+        (void)t;
+        (void)cpu;
+        return false;
+        #endif
     }
+
+    // pins the calling thread to a cpu for as long as it lives, then lets it run on its old cpus again.
+    class ScopedPin {
+        #ifdef __linux__
+        cpu_set_t old;
+        bool pinned = false;
+        #endif
+    public:
+        explicit ScopedPin(int32_t cpu) {
+            #ifdef __linux__
+            if (pthread_getaffinity_np(pthread_self(), sizeof(old), &old) != 0) {
+                return;
+            }
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+            #else
+            (void)cpu;
+            #endif
+        }
+
+        ~ScopedPin() {
+            #ifdef __linux__
+            if (pinned) {
+                pthread_setaffinity_np(pthread_self(), sizeof(old), &old);
+            }
+            #endif
+        }
+
+        ScopedPin(const ScopedPin&) = delete;
+        ScopedPin& operator=(const ScopedPin&) = delete;
+    };
 };
 
-class ColorPrinter {
-public:
-    enum color {
-        black,
-        red,
-        green,
-        yellow,
-        blue,
-        magenta,
-        cyan,
-        white,
-        bold_black,
-        bold_red,
-        bold_green,
-        bold_yellow,
-        bold_blue,
-        bold_magenta,
-        bold_cyan,
-        bold_white,
-        reset
+enum class Bound : uint8_t {
+    none,
+    upper,      // the score is at most this.
+    lower,      // the score is at least this.
+    exact
+};
+
+struct TTEntry {
+    bool hit = false;
+    int32_t score = 0;
+    uint32_t depth = 0;
+    Bound bound = Bound::none;
+    bool hasMove = false;
+    Move mv;
+};
+
+// position hash -> search result, shared by all search threads without locks.
+// an entry holds key ^ data next to data, so one torn by two writers is read as a miss.
+class TranspositionTable {
+    struct Entry {
+        std::atomic<uint64_t> check{ 0 };
+        std::atomic<uint64_t> data{ 0 };
+        std::atomic<uint32_t> busy{ 0 };        // ABDADA: threads searching a node of this slot right now.
     };
 
-    ColorPrinter() {
-        #ifdef _WIN32
-        CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
-        hOutHandle = GetStdHandle(STD_OUTPUT_HANDLE);
-        GetConsoleScreenBufferInfo(hOutHandle, &csbiInfo);
-        oldColorAttrs = csbiInfo.wAttributes;
-        #endif
+    std::unique_ptr<Entry[]> entries;
+    size_t mask;
+
+    static uint64_t pack_square(Pos pos) noexcept {
+        return static_cast<uint64_t>(Board::square(pos));
     }
 
-    ~ColorPrinter() {
-        reset_color();
+    static Pos unpack_square(uint64_t square) noexcept {
+        return Board::to_pos(static_cast<int32_t>(square));
     }
 
-    template<typename T>
-    ColorPrinter& operator<<(T&& printable) {
-        if constexpr (std::is_same_v<T, color>) {
-            if (printable == color::reset) {
-                reset_color();
-            }
-            else {
-                set_color(printable);
-            }
+    // score 32 bits, depth 8, bound 2, has move 1, from 8, to 8.
+    static uint64_t pack(int32_t score, uint32_t depth, Bound bound, const Move* mv) noexcept {
+        uint64_t data = static_cast<uint32_t>(score);
+        data |= static_cast<uint64_t>(std::min<uint32_t>(depth, 255)) << 32;
+        data |= static_cast<uint64_t>(bound) << 40;
+
+        if (mv != nullptr) {
+            data |= 1ull << 42;
+            data |= pack_square(mv->from) << 43;
+            data |= pack_square(mv->to) << 51;
         }
-        else {
-            std::cout << printable;
+
+        return data;
+    }
+
+    Entry& slot(uint64_t key) const noexcept {
+        return entries[key & mask];
+    }
+public:
+    // the size is rounded down to a power of two entries.
+    explicit TranspositionTable(uint32_t mb) {
+        size_t count = 1;
+        while (count * 2 * sizeof(Entry) <= static_cast<size_t>(mb) * 1024 * 1024) {
+            count *= 2;
         }
 
-        return *this;
+        entries.reset(new Entry[count]);
+        mask = count - 1;
     }
-private:
-    void set_color(color c) {
-        #ifdef _WIN32
-        SetConsoleTextAttribute(hOutHandle, get_windows_color_attr(c));
-        #else
-        switch(c) {
-            case color::black:
-                std::cout << "\033[30m"; break;
-            case color::red:
-                std::cout << "\033[31m"; break;
-            case color::green:
-                std::cout << "\033[32m"; break;
-            case color::yellow:       
-                std::cout << "\033[33m"; break;
-            case color::blue:         
-                std::cout << "\033[34m"; break;
-            case color::magenta:      
-                std::cout << "\033[35m"; break;
-            case color::cyan:         
-                std::cout << "\033[36m"; break;
-            case color::white:        
-                std::cout << "\033[37m"; break;
-            case color::bold_black:    
-                std::cout << "\033[1m\033[30m"; break;
-            case color::bold_red:      
-                std::cout << "\033[1m\033[31m"; break;
-            case color::bold_green:    
-                std::cout << "\033[1m\033[32m"; break;
-            case color::bold_yellow:   
-                std::cout << "\033[1m\033[33m"; break;
-            case color::bold_blue:     
-                std::cout << "\033[1m\033[34m"; break;
-            case color::bold_magenta:  
-                std::cout << "\033[1m\033[35m"; break;
-            case color::bold_cyan:     
-                std::cout << "\033[1m\033[36m"; break;
-            case color::bold_white:  
-            default:  
-                std::cout << "\033[1m\033[37m"; break;
+
+    void clear() noexcept {
+        for (size_t i = 0; i <= mask; ++i) {
+            entries[i].check.store(0, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
         }
-        #endif
     }
 
-    void reset_color() {
-        #ifdef _WIN32
-        SetConsoleTextAttribute(hOutHandle, oldColorAttrs);
-        #else
-        std::cout << "\033[0m";
-        #endif
+    TTEntry probe(uint64_t key) const noexcept {
+        Entry& e = slot(key);
+        uint64_t data = e.data.load(std::memory_order_relaxed);
+        uint64_t check = e.check.load(std::memory_order_relaxed);
+        TTEntry result;
+
+        if ((check ^ data) != key || data == 0) {
+            return result;
+        }
+
+        result.hit = true;
+        result.score = static_cast<int32_t>(static_cast<uint32_t>(data));
+        result.depth = static_cast<uint32_t>((data >> 32) & 0xFF);
+        result.bound = static_cast<Bound>((data >> 40) & 0x3);
+        result.hasMove = (data >> 42) & 1;
+
+        if (result.hasMove) {
+            result.mv = Move{ unpack_square((data >> 43) & 0xFF), unpack_square((data >> 51) & 0xFF) };
+        }
+
+        return result;
     }
 
-#ifdef _WIN32
-    WORD get_windows_color_attr(color c) {
+    void store(uint64_t key, uint32_t depth, int32_t score, Bound bound, const Move* mv) noexcept {
+        Entry& e = slot(key);
+        uint64_t data = pack(score, depth, bound, mv);
+
+        e.data.store(data, std::memory_order_relaxed);
+        e.check.store(key ^ data, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32_t>& busy(uint64_t key) noexcept {
+        return slot(key).busy;
+    }
+};
+
+// records spans of work per thread and writes them as chrome trace events, to be opened in
+// chrome://tracing or perfetto. every lane is a ring buffer only ever written by one thread at a time,
+// so recording takes no lock: lane 0 is the thread running the search, worker i of a search uses lane i.
+// a full lane overwrites its oldest events.
+class Tracer {
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        const char* name = nullptr;
+        int64_t beginNs = 0;
+        int64_t endNs = 0;
+        const char* argName = nullptr;      // nullptr for no argument.
+        int64_t value = 0;
+        Move mv;
+        bool hasMove = false;
+    };
+
+    struct Lane {
+        std::vector<Event> events;
+        uint64_t count = 0;
+    };
+
+    static inline std::vector<Lane> lanes;
+    static inline Clock::time_point origin;
+    static inline bool on = false;
+    static inline thread_local uint32_t currentLane = 0;
+
+    static void add(uint32_t lane, const Event& event) noexcept {
+        if (lane >= lanes.size()) {
+            return;
+        }
+
+        Lane& l = lanes[lane];
+        l.events[l.count % l.events.size()] = event;
+        ++l.count;
+    }
+
+    static int64_t since_origin(Clock::time_point t) noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t - origin).count();
+    }
+public:
+    // call once before any search starts.
+    static void enable(uint32_t laneNum, size_t eventsPerLane) {
+        lanes.assign(laneNum, Lane{});
+        for (Lane& lane : lanes) {
+            lane.events.resize(eventsPerLane);
+        }
+
+        origin = Clock::now();
+        on = true;
+    }
+
+    static bool enabled() noexcept {
+        return on;
+    }
+
+    // the lane the calling thread records to from now on.
+    static void set_lane(uint32_t lane) noexcept {
+        currentLane = lane;
+    }
+
+    static Clock::time_point now() noexcept {
+        return on ? Clock::now() : Clock::time_point{};
+    }
+
+    static void record(const char* name, Clock::time_point begin, Clock::time_point end, const char* argName = nullptr, int64_t value = 0, const Move* mv = nullptr) noexcept {
+        record_in(currentLane, name, begin, end, argName, value, mv);
+    }
+
+    // for a lane whose thread has been joined already.
+    static void record_in(uint32_t lane, const char* name, Clock::time_point begin, Clock::time_point end, const char* argName = nullptr, int64_t value = 0, const Move* mv = nullptr) noexcept {
+        if (!on) {
+            return;
+        }
+
+        add(lane, Event{ name, since_origin(begin), since_origin(end), argName, value, mv != nullptr ? *mv : Move{}, mv != nullptr });
+    }
+
+    // writes every lane, oldest events first. call it once all searching threads are done.
+    static void write(const std::string& path) {
+        std::ofstream out{ path };
+        if (!out.is_open()) {
+            throw std::invalid_argument{ "Tracer::write failed, cannot open file: " + path };
+        }
+
+        out << "{\"traceEvents\":[\n";
+        out << std::fixed << std::setprecision(3);
+        bool first = true;
+
+        for (uint32_t lane = 0; lane < lanes.size(); ++lane) {
+            const Lane& l = lanes[lane];
+            if (l.count == 0) {
+                continue;
+            }
+
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << lane;
+            out << ",\"args\":{\"name\":\"" << (lane == 0 ? std::string{ "search" } : "worker " + std::to_string(lane)) << "\"}}";
+            first = false;
+
+            uint64_t begin = l.count > l.events.size() ? l.count - l.events.size() : 0;
+            for (uint64_t i = begin; i < l.count; ++i) {
+                const Event& e = l.events[i % l.events.size()];
+
+                out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"search\",\"ph\":\"X\",\"pid\":1,\"tid\":" << lane;
+                out << ",\"ts\":" << static_cast<double>(e.beginNs) / 1000.0 << ",\"dur\":" << static_cast<double>(e.endNs - e.beginNs) / 1000.0;
+                out << ",\"args\":{";
+
+                if (e.argName != nullptr) {
+                    out << "\"" << e.argName << "\":" << e.value << (e.hasMove ? "," : "");
+                }
+
+                if (e.hasMove) {
+                    out << "\"move\":\"" << Notation::desc(e.mv) << "\"";
+                }
+
+                out << "}}";
+            }
+        }
+
+        out << "\n]}\n";
+    }
+};
+
+// records the span from its construction to its destruction on the calling thread's lane.
+class TraceSpan {
+    const char* name;
+    std::chrono::steady_clock::time_point begin;
+    const char* argName;
+    int64_t value;
+    const Move* mv;
+public:
+    explicit TraceSpan(const char* _name, const char* _argName = nullptr, int64_t _value = 0, const Move* _mv = nullptr) noexcept
+        : name{ _name }, begin{ Tracer::now() }, argName{ _argName }, value{ _value }, mv{ _mv } {}
+
+    ~TraceSpan() {
+        Tracer::record(name, begin, Tracer::now(), argName, value, mv);
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+// progress of an iterative deepening search, reported after every finished depth.
+struct SearchInfo {
+    uint32_t depth;             // in plies, the root move included.
+    int32_t score;              // the bigger the score it is, the better for down side.
+    int64_t timeMs;             // since the search started.
+    uint64_t nodes;
+    uint64_t qnodes;            // the part of nodes searched by quiescence.
+    std::vector<Move> pv;
+};
+
+// data written by different threads is kept this far apart, so they do not share cache lines.
+static constexpr size_t cache_line_size = 64;
+
+// a root move, with what the last finished iteration learned about it.
+// the threads of a root split search write neighbouring root moves at the same time.
+struct alignas(cache_line_size) RootMove {
+    Move mv;
+    int32_t score;              // exact for the best move, a bound for the others.
+    uint64_t nodes;             // spent on its subtree.
+    std::vector<Move> pv;       // starts with mv.
+
+    explicit RootMove(const Move& _mv) : mv{ _mv }, score{ 0 }, nodes{ 0 }, pv{ _mv } {}
+};
+
+// how the threads of a search share the work.
+enum class ParallelMode {
+    root_split,     // root moves are handed out to the threads one at a time.
+    abdada          // all threads search the whole tree and defer nodes someone else is busy with.
+};
+
+enum class SearchAlgorithm {
+    alpha_beta,
+    mcts,
+    mtdf            // alpha beta driven by zero window searches of the root, single threaded.
+};
+
+// how deep, how long and how wide a search may go.
+struct SearchLimits {
+    uint32_t depth = 3;         // alpha beta only.
+    uint32_t movetimeMs = 0;    // 0 means no time limit.
+    uint32_t threads = 1;
+    std::vector<int32_t> cpus;  // worker i runs on cpus[i % cpus.size()], empty means not pinned.
+    ParallelMode parallel = ParallelMode::root_split;
+    SearchAlgorithm algorithm = SearchAlgorithm::alpha_beta;
+    uint32_t playouts = 0;      // mcts only, 0 means no limit.
+    uint32_t treeMb = 64;       // mcts only.
+    bool copyMake = false;
+    bool etc = true;            // enhanced transposition cutoffs, alpha beta only.
+    std::vector<uint32_t> lmpCounts;        // alpha beta only, see BestMoveGen::prune_quiet.
+    std::vector<int32_t> historyMargins;    // alpha beta only, see BestMoveGen::prune_quiet.
+    bool deterministic = false; // alpha beta only, see BestMoveGenParallel::search_root_deterministic.
+};
+
+// shared between the one who starts a search and the threads running it.
+struct SearchControl {
+    std::atomic<bool> stop{ false };
+    std::atomic<uint64_t> nodes{ 0 };
+    std::atomic<uint64_t> qnodes{ 0 };
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    std::function<void(const SearchInfo&)> report;
+    TranspositionTable* tt = nullptr;
+    bool copyMake = false;      // search by copying positions instead of move and undo, ABDADA and mcts ignore it.
+    bool etc = true;            // ABDADA and mcts ignore it.
+    std::vector<uint32_t> lmpCounts;        // by plies left - 1, empty means no late move pruning.
+    std::vector<int32_t> historyMargins;    // by plies left - 1, empty means no history pruning.
+    uint64_t passes = 0;        // zero window root searches run by mtdf.
+
+    bool out_of_time() const {
+        return std::chrono::steady_clock::now() >= deadline;
+    }
+};
+
+// what a searching thread keeps for one ply, allocated once and reused by every node at that ply.
+struct PlyFrame {
+    std::vector<Move> moves;        // of the node, in search order.
+    std::array<Move, 2> killers;    // quiet moves that cut off a sibling node, the newest first.
+    Move currentMove;               // the move searched below the node right now.
+    std::vector<Move> quiets;       // quiet moves searched at the node so far.
+    std::vector<Move> pv;           // the best line below the node.
+    std::vector<bool> deferred;     // ABDADA, by move index, the moves put off because another thread is on them.
+};
+
+// a table store held back until the next synchronization point of a deterministic search.
+struct PendingStore {
+    uint64_t key;
+    uint32_t depth;
+    int32_t score;
+    Bound bound;
+    Move mv;
+    bool hasMove;
+};
+
+// nodes this far from the root are scored by their static evaluation.
+static constexpr uint32_t max_ply = 128;
+
+// owned by a single searching thread. the search indexes frames by the distance from the root.
+struct alignas(cache_line_size) SearchState {
+    SearchControl& control;
+    uint64_t nodes = 0;
+    uint64_t qnodes = 0;
+    const std::atomic<bool>* helperStop = nullptr;     // lets a helper thread be called off on its own.
+    std::vector<PendingStore>* pendingStores = nullptr; // when set, table stores go here instead of the table.
+    bool checkClock = true;     // off when only synchronization points may look at the time.
+    std::vector<PlyFrame> frames;
+
+    // how often a quiet move by piece_index and target square cut off, against how often it was searched
+    // before another quiet move that did. kept between iterations.
+    std::array<int32_t, Zobrist::piece_kinds * Zobrist::square_num> quietHistory{};
+
+    explicit SearchState(SearchControl& _control) : control{ _control }, frames(max_ply + 1) {
+        for (PlyFrame& frame : frames) {
+            frame.moves.reserve(128);
+            frame.quiets.reserve(128);
+            frame.deferred.reserve(128);
+        }
+    }
+
+    int32_t& history_of(const Position& board, const Move& mv) noexcept {
+        return quietHistory[piece_index(board.get(mv.from)) * Zobrist::square_num + Board::square(mv.to)];
+    }
+
+    SearchState(const SearchState&) = delete;
+    SearchState& operator=(const SearchState&) = delete;
+
+    bool stopped() const noexcept {
+        return control.stop.load(std::memory_order_relaxed) || (helperStop != nullptr && helperStop->load(std::memory_order_relaxed));
+    }
+
+    // hands the counts over to control, for searches that report while their threads are still running.
+    void flush() noexcept {
+        control.nodes += nodes;
+        control.qnodes += qnodes;
+        nodes = 0;
+        qnodes = 0;
+    }
+
+    ~SearchState() {
+        flush();
+    }
+};
+
+class BestMoveGen {
+    friend class BestMoveGenParallel;
+    friend class BestMoveGenAbdada;
+    friend class BestMoveGenMcts;
+
+    // the clock is read once every time_check_interval + 1 nodes.
+    static constexpr uint64_t time_check_interval = 1023;
+
+    // enhanced transposition cutoffs only pay off with a subtree big enough to skip.
+    static constexpr uint32_t etc_min_depth = 2;
+
+    // quiet history scores stay within plus and minus history_max.
+    static constexpr int32_t history_max = 1 << 14;
+
+    // what a quiescence capture may gain on top of the captured piece, from piece square tables.
+    static constexpr int32_t delta_margin = 20;
+
+    // with a time limit, an easy move is played once easy_move_time_divisor parts of the time are used.
+    static constexpr uint32_t easy_move_stable_iterations = 2;
+    static constexpr uint64_t easy_move_node_percent = 80;
+    static constexpr int64_t easy_move_time_divisor = 8;
+
+    // the bigger the score it is, the better for down side.
+    // the pv of frame ply receives the best line below this node. once stop is set, the returned value is meaningless.
+    // Node is a Board searched by make and undo, or a Position copied for every ply.
+    template<typename Node>
+    static int32_t min_max(Node& board, SearchState& ss, uint32_t ply, uint32_t searchDepth, int32_t alpha, int32_t beta, bool isMax) {
+        PlyFrame& frame = ss.frames[ply];
+        frame.pv.clear();
+
+        if (searchDepth == 0 || ply == max_ply) {
+            return quiesce(board, ss, ply, alpha, beta, isMax);
+        }
+
+        count_node(ss);
+
+        if (ss.stopped()) {
+            return 0;
+        }
+
+        TTEntry entry = probe(board, ss);
+        if (is_cutoff(entry, searchDepth, alpha, beta)) {
+            return entry.score;
+        }
+
+        int32_t alphaOrig = alpha;
+        int32_t betaOrig = beta;
+        int32_t bestValue;
+        const std::vector<Move>& childPv = ss.frames[ply + 1].pv;
+        MoveList moves{ board, isMax ? Side::down : Side::up, entry, frame };
+
+        if (ss.control.etc && searchDepth >= etc_min_depth) {
+            if (const Move* cut = transposition_cutoff(board, ss, moves, searchDepth, alpha, beta, isMax, bestValue)) {
+                frame.pv.assign(1, *cut);
+                store(board, ss, searchDepth, alphaOrig, betaOrig, bestValue, cut);
+                return bestValue;
+            }
+        }
+
+        frame.quiets.clear();
+        bool mayPrune = searchDepth <= std::max(ss.control.lmpCounts.size(), ss.control.historyMargins.size()) &&
+                        !MovesGen::is_in_check(board, isMax ? Side::down : Side::up);
+
+        if (isMax) {
+            int32_t maxValue = std::numeric_limits<int32_t>::min();
+
+            for (size_t i = 0; const Move* next = moves.get(i); ++i) {
+                const Move mv = *next;
+                if (mayPrune && prune_quiet(board, ss, moves, i, searchDepth)) {
+                    continue;
+                }
+
+                frame.currentMove = mv;
+                bool quiet = board.get(mv.to) == P_EE;
+
+                int32_t val = with_move(board, mv, [&](Node& child) {
+                    return min_max(child, ss, ply + 1, searchDepth - 1, alpha, beta, !isMax);
+                });
+
+                if (val > maxValue) {
+                    maxValue = val;
+                    frame.pv.assign(1, mv);
+                    frame.pv.insert(frame.pv.end(), childPv.begin(), childPv.end());
+                }
+
+                alpha = std::max(alpha, maxValue);
+                if (alpha >= beta) {
+                    remember_killer(board, frame, mv);
+                    update_history(board, ss, frame, mv, searchDepth);
+                    break;
+                }
+
+                if (quiet) {
+                    frame.quiets.push_back(mv);
+                }
+            }
+
+            bestValue = maxValue;
+        }
+        else {
+            int32_t minValue = std::numeric_limits<int32_t>::max();
+
+            for (size_t i = 0; const Move* next = moves.get(i); ++i) {
+                const Move mv = *next;
+                if (mayPrune && prune_quiet(board, ss, moves, i, searchDepth)) {
+                    continue;
+                }
+
+                frame.currentMove = mv;
+                bool quiet = board.get(mv.to) == P_EE;
+
+                int32_t val = with_move(board, mv, [&](Node& child) {
+                    return min_max(child, ss, ply + 1, searchDepth - 1, alpha, beta, !isMax);
+                });
+
+                if (val < minValue) {
+                    minValue = val;
+                    frame.pv.assign(1, mv);
+                    frame.pv.insert(frame.pv.end(), childPv.begin(), childPv.end());
+                }
+
+                beta = std::min(beta, minValue);
+                if (alpha >= beta) {
+                    remember_killer(board, frame, mv);
+                    update_history(board, ss, frame, mv, searchDepth);
+                    break;
+                }
+
+                if (quiet) {
+                    frame.quiets.push_back(mv);
+                }
+            }
+
+            bestValue = minValue;
+        }
+
+        store(board, ss, searchDepth, alphaOrig, betaOrig, bestValue, frame.pv);
+        return bestValue;
+    }
+
+    // a quiet move that cut off is likely to cut off its siblings' children at the same ply as well.
+    static void remember_killer(const Position& board, PlyFrame& frame, const Move& mv) noexcept {
+        if (board.get(mv.to) != P_EE || frame.killers[0] == mv) {
+            return;
+        }
+
+        frame.killers[1] = frame.killers[0];
+        frame.killers[0] = mv;
+    }
+
+    // a quiet cutoff gains depth squared in the history, the quiet moves searched before it lose as much.
+    // the closer a score is to history_max, the less it moves on.
+    static void update_history(const Position& board, SearchState& ss, const PlyFrame& frame, const Move& mv, uint32_t searchDepth) noexcept {
+        if (board.get(mv.to) != P_EE) {
+            return;
+        }
+
+        int32_t bonus = static_cast<int32_t>(std::min(searchDepth * searchDepth, 400u));
+        auto add = [bonus](int32_t& score, int32_t delta) {
+            score += delta - score * bonus / history_max;
+        };
+
+        add(ss.history_of(board, mv), bonus);
+        for (const Move& quiet : frame.quiets) {
+            add(ss.history_of(board, quiet), -bonus);
+        }
+    }
+
+    // captures only, until the position is quiet. the side to move may also stand pat on the static score.
+    // a capture is skipped when even the captured piece and delta_margin on top cannot bring the material,
+    // widened by ScoreEvaluator::positional_margin, into the window, and when the exchange it starts loses
+    // material. the material is used rather than standPat, which a lazy eval may leave as a mere bound, so
+    // the same captures are skipped with lazy eval on or off. entries go to the table with depth 0.
+    template<typename Node>
+    static int32_t quiesce(Node& board, SearchState& ss, uint32_t ply, int32_t alpha, int32_t beta, bool isMax) {
+        PlyFrame& frame = ss.frames[ply];
+        ++ss.qnodes;
+        count_node(ss);
+
+        if (ss.stopped()) {
+            return 0;
+        }
+
+        TTEntry entry = probe(board, ss);
+        if (is_cutoff(entry, 0, alpha, beta)) {
+            return entry.score;
+        }
+
+        int32_t standPat = ScoreEvaluator::evaluate(board, alpha, beta);
+
+        if (ply == max_ply || (isMax ? standPat >= beta : standPat <= alpha)) {
+            return standPat;
+        }
+
+        int32_t alphaOrig = alpha;
+        int32_t betaOrig = beta;
+        int32_t bestValue = standPat;
+        int32_t material = board.material_score();
+        int32_t margin = delta_margin + ScoreEvaluator::positional_margin();
+        Move bestMove;
+        bool hasBestMove = false;
+
+        if (isMax) {
+            alpha = std::max(alpha, standPat);
+        }
+        else {
+            beta = std::min(beta, standPat);
+        }
+
+        std::vector<Move>& captures = frame.moves;
+        captures.clear();
+        MovesGen::gen_captures(board, isMax ? Side::down : Side::up, captures);
+        std::stable_sort(captures.begin(), captures.end(), [&board](const Move& a, const Move& b) {
+            int32_t victimA = ScoreEvaluator::material(board.get(a.to));
+            int32_t victimB = ScoreEvaluator::material(board.get(b.to));
+
+            return victimA != victimB ? victimA > victimB : ScoreEvaluator::material(board.get(a.from)) < ScoreEvaluator::material(board.get(b.from));
+        });
+        put_hash_move_first(captures, entry);
+
+        for (const Move& mv : captures) {
+            frame.currentMove = mv;
+            int32_t victim = ScoreEvaluator::material(board.get(mv.to));
+
+            if (isMax ? material + victim + margin <= alpha : material - victim - margin >= beta) {
+                continue;
+            }
+
+            // taking a piece worth at least the capturing one can never lose material.
+            if (victim < ScoreEvaluator::material(board.get(mv.from)) && see(board, mv) < 0) {
+                continue;
+            }
+
+            int32_t val = with_move(board, mv, [&](Node& child) { return quiesce(child, ss, ply + 1, alpha, beta, !isMax); });
+
+            if (isMax ? val > bestValue : val < bestValue) {
+                bestValue = val;
+                bestMove = mv;
+                hasBestMove = true;
+            }
+
+            if (isMax) {
+                alpha = std::max(alpha, bestValue);
+            }
+            else {
+                beta = std::min(beta, bestValue);
+            }
+
+            if (alpha >= beta) {
+                break;
+            }
+        }
+
+        // a quiescence result must not push out what a real search left for this position.
+        if (!entry.hit || entry.depth == 0) {
+            store(board, ss, 0, alphaOrig, betaOrig, bestValue, hasBestMove ? &bestMove : nullptr);
+        }
+
+        return bestValue;
+    }
+
+    // static exchange evaluation, what the side making mv wins once both sides keep recapturing on mv.to
+    // with their cheapest piece for as long as it pays.
+    template<typename Node>
+    static int32_t see(Node& board, const Move& mv) {
+        Side s = piece_side(board.get(mv.from));
+        int32_t captured = ScoreEvaluator::material(board.get(mv.to));
+
+        return captured - with_move(board, mv, [&](Node& child) { return recapture_gain(child, mv.to, piece_side_reverse(s)); });
+    }
+
+    // what side s wins by recapturing on target, 0 when it is better not to.
+    template<typename Node>
+    static int32_t recapture_gain(Node& board, Pos target, Side s) {
+        Pos from;
+        int32_t fromValue = std::numeric_limits<int32_t>::max();
+
+        MovesGen::for_each_attacker(board, target, s, [&](Pos pos) {
+            int32_t value = ScoreEvaluator::material(board.get(pos));
+
+            if (value < fromValue) {
+                from = pos;
+                fromValue = value;
+            }
+        });
+
+        if (fromValue == std::numeric_limits<int32_t>::max()) {
+            return 0;
+        }
+
+        int32_t captured = ScoreEvaluator::material(board.get(target));
+
+        return std::max(0, captured - with_move(board, Move{ from, target }, [&](Node& child) {
+            return recapture_gain(child, target, piece_side_reverse(s));
+        }));
+    }
+
+    // calls visit with the position after mv: the board itself between move and undo, or a fresh copy of
+    // a position on this thread's stack.
+    template<typename Visit>
+    static int32_t with_move(Board& board, const Move& mv, Visit&& visit) {
+        board.move(mv);
+        int32_t result = visit(board);
+        board.undo();
+        return result;
+    }
+
+    template<typename Visit>
+    static int32_t with_move(const Position& position, const Move& mv, Visit&& visit) {
+        Position child = position;
+        child.make(mv);
+        return visit(child);
+    }
+
+    static void count_node(SearchState& ss) {
+        if ((++ss.nodes & time_check_interval) == 0 && ss.checkClock && ss.control.out_of_time()) {
+            ss.control.stop = true;
+        }
+    }
+
+    static TTEntry probe(const Position& board, const SearchState& ss) noexcept {
+        return ss.control.tt != nullptr ? ss.control.tt->probe(board.hash()) : TTEntry{};
+    }
+
+    // whether a table entry searched at least searchDepth deep already decides the node for this window.
+    static bool is_cutoff(const TTEntry& entry, uint32_t searchDepth, int32_t alpha, int32_t beta) noexcept {
+        if (!entry.hit || entry.depth < searchDepth) {
+            return false;
+        }
+
+        return entry.bound == Bound::exact ||
+               (entry.bound == Bound::lower && entry.score >= beta) ||
+               (entry.bound == Bound::upper && entry.score <= alpha);
+    }
+
+    // the moves of a node in search order, kept in the frame of its ply. a hash move and then the quiet
+    // killer moves that pass is_pseudo_legal are handed out before anything is generated, so a cutoff on
+    // one of them skips move generation altogether.
+    class MoveList {
+        const Position& board;
+        Side side;
+        std::vector<Move>& moves;
+        size_t early = 0;
+        bool generated = false;
+
+        void add_early(const Move& mv) {
+            if (std::find(moves.begin(), moves.end(), mv) == moves.end() && MovesGen::is_pseudo_legal(board, side, mv)) {
+                moves.push_back(mv);
+            }
+        }
+    public:
+        MoveList(const Position& _board, Side _side, const TTEntry& entry, PlyFrame& frame)
+            : board{ _board }, side{ _side }, moves{ frame.moves }
+        {
+            moves.clear();
+
+            if (entry.hasMove) {
+                add_early(entry.mv);
+            }
+
+            for (const Move& killer : frame.killers) {
+                if (board.get(killer.to) == P_EE) {
+                    add_early(killer);
+                }
+            }
+
+            early = moves.size();
+        }
+
+        // the i-th move, nullptr after the last one. moves are asked for in order from 0, and a pointer
+        // only stays good until the next call.
+        const Move* get(size_t i) {
+            if (i == moves.size() && !generated) {
+                generated = true;
+                MovesGen::gen_possible_moves(board, side, moves);
+
+                // is_pseudo_legal let the early moves in, so the generator should have made them again, but a
+                // move it did not make is simply not a duplicate.
+                for (size_t k = 0; k < early; ++k) {
+                    auto it = std::find(moves.begin() + static_cast<std::ptrdiff_t>(early), moves.end(), moves[k]);
+                    if (it != moves.end()) {
+                        moves.erase(it);
+                    }
+                }
+            }
+
+            return i < moves.size() ? &moves[i] : nullptr;
+        }
+
+        // a move already handed out by get.
+        const Move& at(size_t i) const noexcept {
+            return moves[i];
+        }
+
+        // whether the i-th move is the hash move or a killer.
+        bool is_early(size_t i) const noexcept {
+            return i < early;
+        }
+    };
+
+    // enhanced transposition cutoffs: looks up every child in the table before searching any of them, a
+    // child already known to be as good as beta for the side to move cuts this node off right away.
+    // child keys come from Position::hash_after, so nothing is made. returns the move and sets value.
+    static const Move* transposition_cutoff(const Position& board, const SearchState& ss, MoveList& moves, uint32_t searchDepth, int32_t alpha, int32_t beta, bool isMax, int32_t& value) {
+        if (ss.control.tt == nullptr) {
+            return nullptr;
+        }
+
+        for (size_t i = 0; const Move* mv = moves.get(i); ++i) {
+            TTEntry child = ss.control.tt->probe(board.hash_after(*mv));
+
+            if (!child.hit || child.depth < searchDepth - 1) {
+                continue;
+            }
+
+            bool cut = isMax ? (child.bound == Bound::lower || child.bound == Bound::exact) && child.score >= beta
+                             : (child.bound == Bound::upper || child.bound == Bound::exact) && child.score <= alpha;
+            if (cut) {
+                value = child.score;
+                return mv;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // late move pruning and history pruning: with d plies left, a quiet move at index lmpCounts[d - 1] or
+    // later in the move list, or with a history score below -historyMargins[d - 1], is not searched.
+    // the first move, the hash move, killers and checks always are, and so is every move when in check.
+    static bool prune_quiet(const Position& board, SearchState& ss, const MoveList& moves, size_t i, uint32_t searchDepth) {
+        const Move& mv = moves.at(i);
+
+        if (i == 0 || moves.is_early(i) || board.get(mv.to) != P_EE) {
+            return false;
+        }
+
+        const std::vector<uint32_t>& counts = ss.control.lmpCounts;
+        const std::vector<int32_t>& margins = ss.control.historyMargins;
+        bool late = searchDepth <= counts.size() && i >= counts[searchDepth - 1];
+        bool bad = searchDepth <= margins.size() && ss.history_of(board, mv) < -margins[searchDepth - 1];
+
+        return (late || bad) && !MovesGen::gives_check(board, mv);
+    }
+
+    // the hash move is only trusted once it shows up in the generated moves.
+    static void put_hash_move_first(std::vector<Move>& moves, const TTEntry& entry) {
+        if (!entry.hasMove) {
+            return;
+        }
+
+        auto it = std::find(moves.begin(), moves.end(), entry.mv);
+        if (it != moves.end()) {
+            std::rotate(moves.begin(), it, it + 1);
+        }
+    }
+
+    // value came from a search with the window (alpha, beta), results of a stopped search are not kept.
+    static void store(const Position& board, const SearchState& ss, uint32_t searchDepth, int32_t alpha, int32_t beta, int32_t value, const Move* mv) {
+        if (ss.control.tt == nullptr || ss.stopped()) {
+            return;
+        }
+
+        Bound bound = value <= alpha ? Bound::upper : value >= beta ? Bound::lower : Bound::exact;
+
+        if (ss.pendingStores != nullptr) {
+            ss.pendingStores->push_back(PendingStore{ board.hash(), searchDepth, value, bound, mv != nullptr ? *mv : Move{}, mv != nullptr });
+            return;
+        }
+
+        ss.control.tt->store(board.hash(), searchDepth, value, bound, mv);
+    }
+
+    static void store(const Position& board, const SearchState& ss, uint32_t searchDepth, int32_t alpha, int32_t beta, int32_t value, const std::vector<Move>& pv) {
+        store(board, ss, searchDepth, alpha, beta, value, pv.empty() ? nullptr : &pv.front());
+    }
+
+    static bool is_better(Side s, int32_t a, int32_t b) noexcept {
+        return s == Side::up ? a < b : a > b;
+    }
+
+    // the window only asks whether rm beats bound, the best score found so far for side s.
+    static void search_root_move(Board& board, RootMove& rm, Side s, uint32_t searchDepth, int32_t bound, SearchState& ss) {
+        int32_t alpha = s == Side::down ? bound : std::numeric_limits<int32_t>::min();
+        int32_t beta = s == Side::up ? bound : std::numeric_limits<int32_t>::max();
+        search_root_move(board, rm, s, searchDepth, alpha, beta, ss);
+    }
+
+    static void search_root_move(Board& board, RootMove& rm, Side s, uint32_t searchDepth, int32_t alpha, int32_t beta, SearchState& ss) {
+        TraceSpan span{ "root move", "depth", searchDepth + 1, &rm.mv };
+        uint64_t nodesBefore = ss.nodes;
+
+        if (ss.control.copyMake) {
+            Position child = board;
+            child.make(rm.mv);
+            rm.score = min_max(child, ss, 1, searchDepth, alpha, beta, s == Side::up);
+        }
+        else {
+            board.move(rm.mv);
+            rm.score = min_max(board, ss, 1, searchDepth, alpha, beta, s == Side::up);
+            board.undo();
+        }
+
+        rm.pv.assign(1, rm.mv);
+        rm.pv.insert(rm.pv.end(), ss.frames[1].pv.begin(), ss.frames[1].pv.end());
+        rm.nodes = ss.nodes - nodesBefore;
+    }
+
+    // searches the root moves in order, every later move only has to prove it is better than the best one so far.
+    // returns the index of the best move, the first one is kept on ties so the previous iteration's choice wins them.
+    static size_t search_root(Board& board, std::span<RootMove> rootMoves, Side s, uint32_t searchDepth, SearchState& ss) {
+        int32_t bound = s == Side::up ? std::numeric_limits<int32_t>::max() : std::numeric_limits<int32_t>::min();
+        size_t bestIndex = 0;
+
+        for (size_t i = 0; i < rootMoves.size(); ++i) {
+            search_root_move(board, rootMoves[i], s, searchDepth, bound, ss);
+
+            if (i == 0 || is_better(s, rootMoves[i].score, bound)) {
+                bound = rootMoves[i].score;
+                bestIndex = i;
+            }
+        }
+
+        return bestIndex;
+    }
+
+    // MTD(f): zero window searches of the root around a guess, each one moving a bound on the minimax value,
+    // until the two bounds meet. the table keeps what earlier passes learned, so later passes are cheap.
+    // the guess starts from the best score of the previous iteration. the move that proved the bound for
+    // side s last is moved to the front, so the next pass tries it first; the returned index is always 0.
+    // a stop in the middle of a pass leaves the order as the passes before it made it.
+    static size_t search_root_mtdf(Board& board, std::vector<RootMove>& rootMoves, Side s, uint32_t searchDepth, SearchState& ss) {
+        bool isMax = s == Side::down;
+        int32_t lower = std::numeric_limits<int32_t>::min();
+        int32_t upper = std::numeric_limits<int32_t>::max();
+        int32_t guess = rootMoves.front().score;
+
+        for (RootMove& rm : rootMoves) {
+            rm.nodes = 0;
+        }
+
+        while (lower < upper && !ss.stopped()) {
+            int32_t beta = guess == lower ? guess + 1 : guess;
+            int32_t best = isMax ? std::numeric_limits<int32_t>::min() : std::numeric_limits<int32_t>::max();
+            size_t bestIndex = 0;
+
+            ++ss.control.passes;
+
+            for (size_t i = 0; i < rootMoves.size(); ++i) {
+                RootMove& rm = rootMoves[i];
+                uint64_t spent = rm.nodes;
+
+                search_root_move(board, rm, s, searchDepth, beta - 1, beta, ss);
+                rm.nodes += spent;
+
+                // the score of a stopped search is meaningless, the bounds and the order stay as the last
+                // finished pass left them.
+                if (ss.stopped()) {
+                    return 0;
+                }
+
+                if (isMax ? rm.score > best : rm.score < best) {
+                    best = rm.score;
+                    bestIndex = i;
+                }
+
+                if (isMax ? best >= beta : best < beta) {
+                    break;
+                }
+            }
+
+            guess = best;
+            if (guess < beta) {
+                upper = guess;
+            }
+            else {
+                lower = guess;
+            }
+
+            // a pass failing towards side s found a move reaching the bound, the other way nothing was learned
+            // about which move is best.
+            if (isMax == (guess >= beta)) {
+                std::rotate(rootMoves.begin(), rootMoves.begin() + static_cast<std::ptrdiff_t>(bestIndex), rootMoves.begin() + static_cast<std::ptrdiff_t>(bestIndex) + 1);
+            }
+        }
+
+        if (lower == upper) {
+            rootMoves.front().score = lower;
+        }
+
+        return 0;
+    }
+
+    // the best move goes first, the others follow by score, then by how much work refuting them took.
+    // only the best score is exact, the others are bounds that may equal it.
+    static void sort_root_moves(std::vector<RootMove>& rootMoves, Side s, size_t bestIndex) {
+        auto better = [s](int32_t a, int32_t b) { return is_better(s, a, b); };
+        auto best = rootMoves.begin() + bestIndex;
+
+        std::rotate(rootMoves.begin(), best, best + 1);
+        std::stable_sort(rootMoves.begin() + 1, rootMoves.end(), [&better](const RootMove& a, const RootMove& b) {
+            return a.score != b.score ? better(a.score, b.score) : a.nodes > b.nodes;
+        });
+    }
+
+    // an easy move has stayed best for a while and the others were refuted with little effort.
+    static bool is_easy_move(const std::vector<RootMove>& rootMoves, uint32_t stableIterations) {
+        uint64_t total = 0;
+        for (const RootMove& rm : rootMoves) {
+            total += rm.nodes;
+        }
+
+        return stableIterations >= easy_move_stable_iterations && rootMoves.front().nodes * 100 >= total * easy_move_node_percent;
+    }
+
+    // iterative deepening, rootSearch(depth) fills the score, pv and node count of every root move,
+    // and returns the index of the best one.
+    // the first iteration still runs quiescence at the leaves and can be stopped too, then the moves keep
+    // the order they were generated in and the first of them is returned.
+    template<typename RootSearch>
+    static Move deepen(std::vector<RootMove>& rootMoves, Side s, const SearchLimits& limits, SearchControl& control, RootSearch&& rootSearch) {
+        auto startTime = std::chrono::steady_clock::now();
+        uint32_t stableIterations = 0;
+
+        if (rootMoves.empty()) {
+            return Move{};
+        }
+
+        if (limits.movetimeMs != 0) {
+            control.deadline = startTime + std::chrono::milliseconds{ limits.movetimeMs };
+        }
+
+        control.copyMake = limits.copyMake;
+        control.etc = limits.etc;
+        control.lmpCounts = limits.lmpCounts;
+        control.historyMargins = limits.historyMargins;
+
+        for (uint32_t depth = 0; depth <= limits.depth; ++depth) {
+            Move previousBest = rootMoves.front().mv;
+            size_t bestIndex;
+            {
+                TraceSpan span{ "iteration", "depth", depth + 1 };
+                bestIndex = rootSearch(depth);
+            }
+
+            if (control.stop.load()) {    // unfinished iteration, keep the previous order.
+                break;
+            }
+
+            sort_root_moves(rootMoves, s, bestIndex);
+            stableIterations = rootMoves.front().mv == previousBest ? stableIterations + 1 : 0;
+
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+            if (control.report) {
+                const RootMove& best = rootMoves.front();
+                control.report(SearchInfo{ depth + 1, best.score, elapsed.count(), control.nodes.load(), control.qnodes.load(), best.pv });
+            }
+
+            if (limits.movetimeMs != 0 && elapsed.count() * easy_move_time_divisor >= limits.movetimeMs && is_easy_move(rootMoves, stableIterations)) {
+                break;
+            }
+        }
+
+        return rootMoves.front().mv;
+    }
+
+    static std::vector<RootMove> make_root_moves(const Board& board, Side s) {
+        std::vector<RootMove> rootMoves;
+
+        for (const Move& mv : MovesGen::gen_possible_moves(board, s)) {
+            rootMoves.emplace_back(mv);
+        }
+
+        return rootMoves;
+    }
+public:
+    static Move gen(Board& board, Side s, const SearchLimits& limits, SearchControl& control) {
+        assert(s != Side::extra);
+
+        auto rootMoves = make_root_moves(board, s);
+        SearchState ss{ control };
+
+        // one state for all iterations, so the killers found in one help the next.
+        return deepen(rootMoves, s, limits, control, [&](uint32_t depth) {
+            size_t bestIndex = limits.algorithm == SearchAlgorithm::mtdf ? search_root_mtdf(board, rootMoves, s, depth, ss) : search_root(board, rootMoves, s, depth, ss);
+            ss.flush();
+            return bestIndex;
+        });
+    }
+};
+
+// ABDADA: every thread searches the whole tree. a node another thread is inside of right now is put off
+// while there are other siblings to search, so the threads spread over the tree and share their work
+// through the transposition table.
+class BestMoveGenAbdada {
+    // returned for a node someone else is busy with, only when the caller asked for exclusive access.
+    static constexpr int32_t on_evaluation = std::numeric_limits<int32_t>::min() + 1;
+
+    // putting off nodes this shallow costs more than searching them twice.
+    static constexpr uint32_t exclusive_min_depth = 2;
+
+    // marks the node busy in the table for as long as a thread is searching it.
+    class BusyGuard {
+        std::atomic<uint32_t>* busy;
+    public:
+        explicit BusyGuard(std::atomic<uint32_t>* _busy) : busy{ _busy } {
+            if (busy != nullptr) {
+                ++*busy;
+            }
+        }
+
+        ~BusyGuard() {
+            if (busy != nullptr) {
+                --*busy;
+            }
+        }
+
+        BusyGuard(const BusyGuard&) = delete;
+        BusyGuard& operator=(const BusyGuard&) = delete;
+    };
+
+    // the same as BestMoveGen::min_max, but siblings searched exclusively may come back as on_evaluation,
+    // those are searched again in a second pass once everything else is done.
+    static int32_t search(Board& board, SearchState& ss, uint32_t ply, uint32_t searchDepth, int32_t alpha, int32_t beta, bool isMax, bool exclusive) {
+        PlyFrame& frame = ss.frames[ply];
+        frame.pv.clear();
+
+        if (searchDepth == 0 || ply == max_ply) {
+            return BestMoveGen::quiesce(board, ss, ply, alpha, beta, isMax);
+        }
+
+        BestMoveGen::count_node(ss);
+
+        if (ss.stopped()) {
+            return 0;
+        }
+
+        TTEntry entry = BestMoveGen::probe(board, ss);
+        if (BestMoveGen::is_cutoff(entry, searchDepth, alpha, beta)) {
+            return entry.score;
+        }
+
+        std::atomic<uint32_t>* busy = ss.control.tt != nullptr ? &ss.control.tt->busy(board.hash()) : nullptr;
+        if (exclusive && searchDepth >= exclusive_min_depth && busy != nullptr && busy->load(std::memory_order_relaxed) != 0) {
+            return on_evaluation;
+        }
+
+        BusyGuard guard{ busy };
+
+        int32_t alphaOrig = alpha;
+        int32_t betaOrig = beta;
+        int32_t bestValue = isMax ? std::numeric_limits<int32_t>::min() : std::numeric_limits<int32_t>::max();
+        const std::vector<Move>& childPv = ss.frames[ply + 1].pv;
+
+        std::vector<Move>& moves = frame.moves;
+        moves.clear();
+        MovesGen::gen_possible_moves(board, isMax ? Side::down : Side::up, moves);
+        BestMoveGen::put_hash_move_first(moves, entry);
+
+        std::vector<bool>& deferred = frame.deferred;
+        deferred.assign(moves.size(), false);
+        bool anyDeferred = false;
+        bool searchedOne = false;
+
+        for (int32_t pass = 0; pass < 2 && alpha < beta; ++pass) {
+            for (size_t i = 0; i < moves.size() && alpha < beta; ++i) {
+                if (pass == 1 && !deferred[i]) {
+                    continue;
+                }
+
+                frame.currentMove = moves[i];
+                board.move(moves[i]);
+                int32_t val = search(board, ss, ply + 1, searchDepth - 1, alpha, beta, !isMax, pass == 0 && searchedOne);
+                board.undo();
+
+                if (val == on_evaluation) {
+                    deferred[i] = true;
+                    anyDeferred = true;
+                    continue;
+                }
+
+                searchedOne = true;
+
+                if (isMax ? val > bestValue : val < bestValue) {
+                    bestValue = val;
+                    frame.pv.assign(1, moves[i]);
+                    frame.pv.insert(frame.pv.end(), childPv.begin(), childPv.end());
+                }
+
+                if (isMax) {
+                    alpha = std::max(alpha, bestValue);
+                }
+                else {
+                    beta = std::min(beta, bestValue);
+                }
+            }
+
+            if (!anyDeferred) {
+                break;
+            }
+        }
+
+        BestMoveGen::store(board, ss, searchDepth, alphaOrig, betaOrig, bestValue, frame.pv);
+        return bestValue;
+    }
+
+    // the root of one thread, the same two passes as search. returns the index of the best move.
+    static size_t search_root(Board& board, std::vector<RootMove>& rootMoves, Side s, uint32_t searchDepth, SearchState& ss) {
+        int32_t bound = s == Side::up ? std::numeric_limits<int32_t>::max() : std::numeric_limits<int32_t>::min();
+        std::vector<bool> deferred(rootMoves.size(), false);
+        size_t bestIndex = 0;
+        bool searchedOne = false;
+
+        for (int32_t pass = 0; pass < 2; ++pass) {
+            for (size_t i = 0; i < rootMoves.size(); ++i) {
+                if (pass == 1 && !deferred[i]) {
+                    continue;
+                }
+
+                RootMove& rm = rootMoves[i];
+                int32_t alpha = s == Side::down ? bound : std::numeric_limits<int32_t>::min();
+                int32_t beta = s == Side::up ? bound : std::numeric_limits<int32_t>::max();
+                uint64_t nodesBefore = ss.nodes;
+
+                board.move(rm.mv);
+                int32_t val = search(board, ss, 1, searchDepth, alpha, beta, s == Side::up, pass == 0 && searchedOne);
+                board.undo();
+
+                if (val == on_evaluation) {
+                    deferred[i] = true;
+                    continue;
+                }
+
+                deferred[i] = false;
+                rm.score = val;
+                rm.pv.assign(1, rm.mv);
+                rm.pv.insert(rm.pv.end(), ss.frames[1].pv.begin(), ss.frames[1].pv.end());
+                rm.nodes = ss.nodes - nodesBefore;
+
+                if (!searchedOne || BestMoveGen::is_better(s, val, bound)) {
+                    bound = val;
+                    bestIndex = i;
+                }
+
+                searchedOne = true;
+            }
+        }
+
+        return bestIndex;
+    }
+
+    // the first thread works on the real root moves, the helpers on copies. helpers are called off as soon as
+    // the first thread is done, everything they found is already in the table.
+    static size_t search_root_parallel(const Board& board, std::vector<RootMove>& rootMoves, Side s, uint32_t searchDepth, const SearchLimits& limits, SearchControl& control) {
+        std::atomic<bool> helperStop{ false };
+        std::vector<std::thread> helpers;
+
+        for (uint32_t i = 1; i < std::max<uint32_t>(limits.threads, 1); ++i) {
+            // copied here, before the first thread starts writing to rootMoves.
+            helpers.emplace_back([&board, tempRootMoves = rootMoves, &control, &helperStop, s, searchDepth, i]() mutable {
+                Tracer::set_lane(i);
+                TraceSpan span{ "helper", "depth", searchDepth + 1 };
+                Board tempBoard = board;
+                SearchState ss{ control };
+                ss.helperStop = &helperStop;
+
+                search_root(tempBoard, tempRootMoves, s, searchDepth, ss);
+            });
+
+            if (!limits.cpus.empty()) {
+                ThreadAffinity::pin(helpers.back(), limits.cpus[i % limits.cpus.size()]);
+            }
+        }
+
+        Board tempBoard = board;
+        size_t bestIndex;
+        {
+            SearchState ss{ control };
+            bestIndex = search_root(tempBoard, rootMoves, s, searchDepth, ss);
+        }
+
+        helperStop = true;
+        TraceSpan span{ "waiting" };
+        for (auto& helper : helpers) {
+            helper.join();
+        }
+
+        return bestIndex;
+    }
+public:
+    // the calling thread is the first of limits.threads searching threads, pinned to the first cpu for the
+    // search when threads are pinned.
+    static Move gen(Board& board, Side s, const SearchLimits& limits, SearchControl& control) {
+        assert(s != Side::extra);
+
+        std::optional<ThreadAffinity::ScopedPin> pin;
+        if (!limits.cpus.empty()) {
+            pin.emplace(limits.cpus.front());
+        }
+
+        auto rootMoves = BestMoveGen::make_root_moves(board, s);
+
+        return BestMoveGen::deepen(rootMoves, s, limits, control, [&](uint32_t depth) {
+            return search_root_parallel(board, rootMoves, s, depth, limits, control);
+        });
+    }
+};
+
+// monte carlo tree search. every playout walks down the tree by UCT, expands the leaf it reaches once it
+// was scored before, scores it with a quiescence search and backs the result up the path.
+// the threads share one tree. a thread counts its visit on the way down and adds the result only on the
+// way back, so until then the visit is a virtual loss and the others pick different lines.
+class BestMoveGenMcts {
+    static constexpr double exploration = 1.4;
+
+    // turns a score into the chance to win, a rook up is about 73%.
+    static constexpr double score_scale = 100.0;
+
+    // a leaf is expanded on its second visit, so one off playouts do not fill the pool with children.
+    static constexpr uint32_t expand_visits = 2;
+
+    static constexpr uint64_t first_report = 1024;
+    static constexpr uint64_t flush_interval = 256;
+    static constexpr size_t max_pv_length = 16;
+
+    enum State : uint8_t {
+        unexpanded,
+        expanding,
+        expanded
+    };
+
+    struct Node {
+        Move mv;                            // the move leading here.
+        std::atomic<uint32_t> visits{ 0 };  // virtual losses included.
+        std::atomic<double> wins{ 0 };      // for the side that played mv.
+        std::atomic<State> state{ unexpanded };
+        uint32_t firstChild = 0;            // valid once state is expanded.
+        uint32_t childCount = 0;
+    };
+
+    // every node comes from one block allocated when the search starts, children sit next to each other.
+    class NodePool {
+        std::unique_ptr<Node[]> nodes;
+        uint32_t capacity;
+        std::atomic<uint32_t> used{ 0 };
+    public:
+        explicit NodePool(uint32_t mb)
+            : capacity{ static_cast<uint32_t>(std::clamp<uint64_t>(static_cast<uint64_t>(mb) * 1024 * 1024 / sizeof(Node), 1, std::numeric_limits<uint32_t>::max() / 2)) }
+        {
+            nodes.reset(new Node[capacity]);
+        }
+
+        Node& operator[](uint32_t index) noexcept {
+            return nodes[index];
+        }
+
+        bool full() const noexcept {
+            return used.load(std::memory_order_relaxed) >= capacity;
+        }
+
+        // returns the first of count new nodes, or capacity when they do not fit any more.
+        uint32_t allocate(uint32_t count) noexcept {
+            uint32_t first = used.fetch_add(count);
+            return first + count <= capacity ? first : capacity;
+        }
+
+        uint32_t end() const noexcept {
+            return capacity;
+        }
+    };
+
+    // the side to move is s. a node without legal moves stays expanded with no children, it is lost.
+    static void expand(Board& board, Side s, NodePool& pool, Node& node) {
+        State expected = unexpanded;
+        if (pool.full() || !node.state.compare_exchange_strong(expected, expanding)) {
+            return;
+        }
+
+        auto moves = MovesGen::gen_legal_moves(board, s);
+        uint32_t first = moves.empty() ? 0 : pool.allocate(static_cast<uint32_t>(moves.size()));
+
+        if (first == pool.end()) {
+            node.state.store(unexpanded, std::memory_order_release);
+            return;
+        }
+
+        for (size_t i = 0; i < moves.size(); ++i) {
+            pool[first + i].mv = moves[i];
+        }
+
+        node.firstChild = first;
+        node.childCount = static_cast<uint32_t>(moves.size());
+        node.state.store(expanded, std::memory_order_release);
+    }
+
+    static bool has_children(const Node& node) noexcept {
+        return node.state.load(std::memory_order_acquire) == expanded && node.childCount != 0;
+    }
+
+    // unvisited children first, then the best upper confidence bound.
+    static uint32_t select_child(NodePool& pool, const Node& node) {
+        double logVisits = std::log(std::max<double>(node.visits.load(std::memory_order_relaxed), 1.0));
+        uint32_t best = node.firstChild;
+        double bestValue = -1;
+
+        for (uint32_t i = node.firstChild; i < node.firstChild + node.childCount; ++i) {
+            uint32_t visits = pool[i].visits.load(std::memory_order_relaxed);
+
+            if (visits == 0) {
+                return i;
+            }
+
+            double value = pool[i].wins.load(std::memory_order_relaxed) / visits + exploration * std::sqrt(logVisits / visits);
+            if (value > bestValue) {
+                bestValue = value;
+                best = i;
+            }
+        }
+
+        return best;
+    }
+
+    static double win_chance(int32_t score, Side s) noexcept {
+        double down = 1.0 / (1.0 + std::exp(-score / score_scale));
+        return s == Side::down ? down : 1.0 - down;
+    }
+
+    // the other way round, a score for down side.
+    static int32_t to_score(double winChance, Side s) noexcept {
+        double p = std::clamp(winChance, 0.001, 0.999);
+        int32_t score = static_cast<int32_t>(std::lround(score_scale * std::log(p / (1.0 - p))));
+        return s == Side::down ? score : -score;
+    }
+
+    // returns how many plies the playout went down the tree.
+    static uint32_t playout(Board& board, Side s, NodePool& pool, SearchState& ss, std::vector<uint32_t>& path) {
+        uint32_t index = 0;
+        Side side = s;
+
+        path.assign(1, 0);
+        pool[0].visits.fetch_add(1, std::memory_order_relaxed);
+
+        while (has_children(pool[index])) {
+            index = select_child(pool, pool[index]);
+            pool[index].visits.fetch_add(1, std::memory_order_relaxed);
+
+            board.move(pool[index].mv);
+            side = piece_side_reverse(side);
+            path.push_back(index);
+        }
+
+        Node& leaf = pool[index];
+        if (leaf.visits.load(std::memory_order_relaxed) >= expand_visits) {
+            expand(board, side, pool, leaf);
+        }
+
+        // for the side that moved into the leaf.
+        double value;
+        if (leaf.state.load(std::memory_order_acquire) == expanded && leaf.childCount == 0) {
+            value = 1.0;
+        }
+        else {
+            int32_t score = BestMoveGen::quiesce(board, ss, 0, std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max(), side == Side::down);
+            value = win_chance(score, piece_side_reverse(side));
+        }
+
+        for (size_t i = path.size(); i-- > 0;) {
+            pool[path[i]].wins.fetch_add(value, std::memory_order_relaxed);
+            value = 1.0 - value;
+
+            if (i > 0) {
+                board.undo();
+            }
+        }
+
+        return static_cast<uint32_t>(path.size() - 1);
+    }
+
+    static uint32_t most_visited_child(NodePool& pool, const Node& node) {
+        uint32_t best = node.firstChild;
+
+        for (uint32_t i = node.firstChild; i < node.firstChild + node.childCount; ++i) {
+            if (pool[i].visits.load(std::memory_order_relaxed) > pool[best].visits.load(std::memory_order_relaxed)) {
+                best = i;
+            }
+        }
+
+        return best;
+    }
+
+    static SearchInfo make_info(NodePool& pool, Side s, uint32_t depth, int64_t timeMs, const SearchControl& control) {
+        SearchInfo info{ depth, 0, timeMs, control.nodes.load(), control.qnodes.load(), {} };
+        uint32_t best = most_visited_child(pool, pool[0]);
+        uint32_t visits = std::max<uint32_t>(pool[best].visits.load(std::memory_order_relaxed), 1);
+
+        info.score = to_score(pool[best].wins.load(std::memory_order_relaxed) / visits, s);
+
+        for (uint32_t index = 0; has_children(pool[index]) && info.pv.size() < max_pv_length; ) {
+            index = most_visited_child(pool, pool[index]);
+
+            if (pool[index].visits.load(std::memory_order_relaxed) == 0) {
+                break;
+            }
+
+            info.pv.push_back(pool[index].mv);
+        }
+
+        return info;
+    }
+public:
+    // runs limits.playouts playouts, or until limits.movetimeMs is over or stop is set, whatever comes first.
+    // the tree takes at most limits.treeMb megabytes, when it is full the leaves are only scored.
+    static Move gen(Board& board, Side s, const SearchLimits& limits, SearchControl& control) {
+        assert(s != Side::extra);
+
+        auto startTime = std::chrono::steady_clock::now();
+        if (limits.movetimeMs != 0) {
+            control.deadline = startTime + std::chrono::milliseconds{ limits.movetimeMs };
+        }
+
+        NodePool pool{ limits.treeMb };
+        Node& root = pool[pool.allocate(1)];
+
+        expand(board, s, pool, root);
+        if (!has_children(root)) {
+            return Move{};
+        }
+
+        std::atomic<uint64_t> playouts{ 0 };
+        std::atomic<uint32_t> maxDepth{ 0 };
+
+        auto elapsed_ms = [startTime]() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+        };
+
+        // only the first worker reports, so report is never called from two threads at once.
+        auto work = [&](size_t id) {
+            Board tempBoard = board;
+            SearchState ss{ control };
+            std::vector<uint32_t> path;
+            uint64_t nextReport = first_report;
+
+            while (!ss.stopped()) {
+                uint64_t done = playouts++;
+                if (limits.playouts != 0 && done >= limits.playouts) {
+                    break;
+                }
+
+                uint32_t depth = playout(tempBoard, s, pool, ss, path);
+                for (uint32_t seen = maxDepth.load(); depth > seen && !maxDepth.compare_exchange_weak(seen, depth); ) {}
+
+                if (control.out_of_time()) {
+                    control.stop = true;
+                }
+
+                if ((done & (flush_interval - 1)) == 0) {
+                    ss.flush();
+                }
+
+                if (id == 0 && done + 1 >= nextReport && control.report) {
+                    control.report(make_info(pool, s, maxDepth, elapsed_ms(), control));
+                    nextReport *= 2;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < std::max<uint32_t>(limits.threads, 1); ++i) {
+            workers.emplace_back(work, i);
+
+            if (!limits.cpus.empty()) {
+                ThreadAffinity::pin(workers.back(), limits.cpus[i % limits.cpus.size()]);
+            }
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        if (control.report) {
+            control.report(make_info(pool, s, maxDepth, elapsed_ms(), control));
+        }
+
+        return pool[most_visited_child(pool, root)].mv;
+    }
+};
+
+class BestMoveGenParallel {
+    // the previous best move first, then the others by the size of their last subtree, biggest first.
+    // hard moves are started early, so the cheap ones fill the gaps at the end of an iteration.
+    static std::vector<size_t> dispatch_order(const std::vector<RootMove>& rootMoves) {
+        std::vector<size_t> order(rootMoves.size());
+        std::iota(order.begin(), order.end(), 0);
+
+        std::stable_sort(order.begin() + 1, order.end(), [&rootMoves](size_t a, size_t b) {
+            return rootMoves[a].nodes > rootMoves[b].nodes;
+        });
+
+        return order;
+    }
+
+    // one per worker, made once per search and handed to every iteration, so the quiet history and the
+    // killers carry over from one iteration to the next.
+    static std::vector<std::unique_ptr<SearchState>> make_states(size_t workerNum, SearchControl& control) {
+        std::vector<std::unique_ptr<SearchState>> states;
+
+        for (size_t i = 0; i < workerNum; ++i) {
+            states.push_back(std::make_unique<SearchState>(control));
+        }
+
+        return states;
+    }
+
+    // root moves go out in batches of one per worker, worker i always taking the i-th move of a batch. every
+    // batch starts from the bound and the table as the previous one left them: stores are held back per
+    // worker and written in worker order once the whole batch is done, and the clock is only read between
+    // batches. the result and the node counts then depend on the thread count alone, not on timing.
+    static size_t search_root_deterministic(const Board& board, std::vector<RootMove>& rootMoves, Side s, uint32_t searchDepth, const SearchLimits& limits, SearchControl& control, std::vector<std::unique_ptr<SearchState>>& states) {
+        std::vector<size_t> order = dispatch_order(rootMoves);
+        size_t workerNum = std::min(states.size(), rootMoves.size());
+
+        std::vector<Board> boards(workerNum, board);
+        std::vector<std::vector<PendingStore>> pending(workerNum);
+
+        for (size_t i = 0; i < workerNum; ++i) {
+            states[i]->pendingStores = &pending[i];
+            states[i]->checkClock = false;
+        }
+
+        int32_t bestScore = s == Side::up ? std::numeric_limits<int32_t>::max() : std::numeric_limits<int32_t>::min();
+        size_t bestIndex = order.front();
+
+        for (size_t first = 0; first < order.size(); first += workerNum) {
+            if (first > 0 && control.out_of_time()) {
+                control.stop = true;
+            }
+
+            if (control.stop.load()) {
+                break;
+            }
+
+            size_t batch = std::min(workerNum, order.size() - first);
+            std::vector<std::thread> workers;
+
+            for (size_t i = 0; i < batch; ++i) {
+                workers.emplace_back([&, i]() {
+                    Tracer::set_lane(static_cast<uint32_t>(i + 1));
+                    BestMoveGen::search_root_move(boards[i], rootMoves[order[first + i]], s, searchDepth, bestScore, *states[i]);
+                });
+
+                if (!limits.cpus.empty()) {
+                    ThreadAffinity::pin(workers.back(), limits.cpus[i % limits.cpus.size()]);
+                }
+            }
+
+            {
+                TraceSpan span{ "waiting" };
+                for (auto& worker : workers) {
+                    worker.join();
+                }
+            }
+
+            for (size_t i = 0; i < batch; ++i) {
+                if (control.tt != nullptr) {
+                    for (const PendingStore& ps : pending[i]) {
+                        control.tt->store(ps.key, ps.depth, ps.score, ps.bound, ps.hasMove ? &ps.mv : nullptr);
+                    }
+                }
+
+                pending[i].clear();
+
+                const RootMove& rm = rootMoves[order[first + i]];
+                if (first + i == 0 || BestMoveGen::is_better(s, rm.score, bestScore)) {
+                    bestScore = rm.score;
+                    bestIndex = order[first + i];
+                }
+            }
+        }
+
+        for (size_t i = 0; i < workerNum; ++i) {
+            states[i]->pendingStores = nullptr;
+            states[i]->flush();
+        }
+
+        return bestIndex;
+    }
+
+    // every worker pulls the next root move from a shared index until none is left, so no thread sits idle
+    // while another one still holds a queue of moves. the best score so far is shared as the search window.
+    static size_t search_root_parallel(const Board& board, std::vector<RootMove>& rootMoves, Side s, uint32_t searchDepth, const SearchLimits& limits, std::vector<std::unique_ptr<SearchState>>& states) {
+        std::vector<size_t> order = dispatch_order(rootMoves);
+        std::atomic<size_t> next{ 0 };
+
+        std::mutex bestMutex;
+        int32_t bestScore = s == Side::up ? std::numeric_limits<int32_t>::max() : std::numeric_limits<int32_t>::min();
+        size_t bestIndex = order.front();
+        bool found = false;
+
+        size_t workerNum = std::min(states.size(), rootMoves.size());
+        std::vector<std::chrono::steady_clock::time_point> finished(workerNum);
+
+        auto work = [&](size_t worker) {
+            Tracer::set_lane(static_cast<uint32_t>(worker + 1));
+            Board tempBoard = board;
+            SearchState& ss = *states[worker];
+
+            for (size_t i = next++; i < order.size(); i = next++) {
+                RootMove& rm = rootMoves[order[i]];
+                int32_t bound;
+                {
+                    std::lock_guard<std::mutex> lock{ bestMutex };
+                    bound = bestScore;
+                }
+
+                BestMoveGen::search_root_move(tempBoard, rm, s, searchDepth, bound, ss);
+
+                std::lock_guard<std::mutex> lock{ bestMutex };
+                if (!found || BestMoveGen::is_better(s, rm.score, bestScore)) {
+                    bestScore = rm.score;
+                    bestIndex = order[i];
+                    found = true;
+                }
+            }
+
+            ss.flush();
+            finished[worker] = Tracer::now();
+        };
+
+        std::vector<std::thread> workers;
+
+        for (size_t i = 0; i < workerNum; ++i) {
+            workers.emplace_back(work, i);
+
+            if (!limits.cpus.empty()) {
+                ThreadAffinity::pin(workers.back(), limits.cpus[i % limits.cpus.size()]);
+            }
+        }
+
+        {
+            TraceSpan span{ "waiting" };
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        // a worker out of root moves is idle until the slowest one is done.
+        auto allDone = Tracer::now();
+        for (size_t i = 0; i < workerNum; ++i) {
+            Tracer::record_in(static_cast<uint32_t>(i + 1), "idle", finished[i], allDone);
+        }
+
+        return bestIndex;
+    }
+public:
+    // limits.threads workers share the root moves of every iteration, or search with ABDADA, monte carlo
+    // tree search or MTD(f) if asked to, or deterministically.
+    static Move gen(Board& board, Side s, const SearchLimits& limits, SearchControl& control) {
+        assert(s != Side::extra);
+
+        if (limits.algorithm == SearchAlgorithm::mcts) {
+            return BestMoveGenMcts::gen(board, s, limits, control);
+        }
+
+        if (limits.algorithm == SearchAlgorithm::mtdf) {
+            return BestMoveGen::gen(board, s, limits, control);
+        }
+
+        auto rootMoves = BestMoveGen::make_root_moves(board, s);
+
+        // ABDADA lives on timing, a deterministic search always splits at the root.
+        if (limits.parallel == ParallelMode::abdada && !limits.deterministic) {
+            return BestMoveGenAbdada::gen(board, s, limits, control);
+        }
+
+        auto states = make_states(std::min<size_t>(std::max<uint32_t>(limits.threads, 1), rootMoves.size()), control);
+
+        if (limits.deterministic) {
+            return BestMoveGen::deepen(rootMoves, s, limits, control, [&](uint32_t depth) {
+                return search_root_deterministic(board, rootMoves, s, depth, limits, control, states);
+            });
+        }
+
+        return BestMoveGen::deepen(rootMoves, s, limits, control, [&](uint32_t depth) {
+            return search_root_parallel(board, rootMoves, s, depth, limits, states);
+        });
+    }
+};
+
+// proves forced mates with depth first proof number search. the attacker only plays checks, the defender
+// every legal move, and the attacker wins once the defender has no legal move left.
+// proof and disproof numbers go to a table of its own, keyed by position and the attacker moves left, so
+// the same position is never on a line twice under one key and there are no cycles to take care of.
+class MateSolver {
+    static constexpr uint32_t infinity = 100000000;
+    static constexpr uint64_t time_check_interval = 1023;
+
+    struct Entry {
+        uint64_t key = 0;
+        uint32_t pn = 1;
+        uint32_t dn = 1;
+    };
+
+    std::unique_ptr<Entry[]> entries;
+    size_t mask;
+    SearchControl& control;
+    uint64_t nodes;
+
+    static uint64_t key_of(uint64_t hash, uint32_t movesLeft) noexcept {
+        return hash ^ (movesLeft * 0x9E3779B97F4A7C15ull);
+    }
+
+    // a position not in the table yet counts 1 both ways.
+    Entry lookup(uint64_t key) const noexcept {
+        const Entry& e = entries[key & mask];
+        return e.key == key ? e : Entry{ key, 1, 1 };
+    }
+
+    void store(uint64_t key, uint32_t pn, uint32_t dn) noexcept {
+        entries[key & mask] = Entry{ key, pn, dn };
+    }
+
+    static uint32_t add(uint32_t a, uint32_t b) noexcept {
+        return std::min(a + b, infinity);
+    }
+
+    // attacker moves must give check, defender moves only have to be legal.
+    static std::vector<Move> gen_moves(Board& board, Side s, bool attacker) {
+        auto moves = MovesGen::gen_legal_moves(board, s);
+
+        if (attacker) {
+            auto it = std::remove_if(moves.begin(), moves.end(), [&board](const Move& mv) { return !MovesGen::gives_check(board, mv); });
+            moves.erase(it, moves.end());
+        }
+
+        return moves;
+    }
+
+    // works on the node until its own number (pn for the attacker, dn for the defender) reaches phiLimit, or
+    // the other one reaches deltaLimit, and leaves both in the table.
+    void mid(Board& board, Side s, bool attacker, uint32_t movesLeft, uint32_t phiLimit, uint32_t deltaLimit) {
+        uint64_t key = key_of(board.hash(), movesLeft);
+
+        if ((++nodes & time_check_interval) == 0 && control.out_of_time()) {
+            control.stop = true;
+        }
+
+        if (attacker && movesLeft == 0) {
+            store(key, infinity, 0);
+            return;
+        }
+
+        auto moves = gen_moves(board, s, attacker);
+        if (moves.empty()) {
+            if (attacker) {
+                store(key, infinity, 0);
+            }
+            else {
+                store(key, 0, infinity);
+            }
+            return;
+        }
+
+        // the defender still has a move after the attacker's last one.
+        if (!attacker && movesLeft == 0) {
+            store(key, infinity, 0);
+            return;
+        }
+
+        uint32_t childMovesLeft = attacker ? movesLeft - 1 : movesLeft;
+        std::vector<uint64_t> childKeys;
+        childKeys.reserve(moves.size());
+
+        for (const Move& mv : moves) {
+            board.move(mv);
+            childKeys.push_back(key_of(board.hash(), childMovesLeft));
+            board.undo();
+        }
+
+        while (true) {
+            // phi is the number this node tries to bring down, delta the other one. a child's phi and delta are
+            // the other way round from ours, as the other side is to move there.
+            uint32_t phi = infinity;
+            uint32_t delta = 0;
+            uint32_t secondBest = infinity;
+            size_t best = 0;
+            uint32_t bestChildPhi = 0;
+
+            for (size_t i = 0; i < childKeys.size(); ++i) {
+                Entry child = lookup(childKeys[i]);
+                uint32_t childPhi = attacker ? child.dn : child.pn;
+                uint32_t childDelta = attacker ? child.pn : child.dn;
+
+                delta = add(delta, childPhi);
+
+                if (childDelta < phi) {
+                    secondBest = phi;
+                    phi = childDelta;
+                    best = i;
+                    bestChildPhi = childPhi;
+                }
+                else if (childDelta < secondBest) {
+                    secondBest = childDelta;
+                }
+            }
+
+            if (phi >= phiLimit || delta >= deltaLimit || control.stop.load(std::memory_order_relaxed)) {
+                store(key, attacker ? phi : delta, attacker ? delta : phi);
+                return;
+            }
+
+            uint32_t childPhiLimit = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(deltaLimit) + bestChildPhi - delta, infinity));
+            uint32_t childDeltaLimit = std::min(phiLimit, add(secondBest, 1));
+
+            board.move(moves[best]);
+            mid(board, piece_side_reverse(s), !attacker, childMovesLeft, childPhiLimit, childDeltaLimit);
+            board.undo();
+        }
+    }
+
+    // follows proven nodes: a mating check for the attacker, any answer for the defender.
+    std::vector<Move> proof_line(Board& board, Side s, uint32_t movesLeft) {
+        std::vector<Move> pv;
+        bool attacker = true;
+
+        while (movesLeft > 0 || !attacker) {
+            const Move* next = nullptr;
+            auto moves = gen_moves(board, s, attacker);
+            uint32_t childMovesLeft = attacker ? movesLeft - 1 : movesLeft;
+
+            for (const Move& mv : moves) {
+                board.move(mv);
+                Entry child = lookup(key_of(board.hash(), childMovesLeft));
+                board.undo();
+
+                if (child.pn == 0) {
+                    next = &mv;
+                    break;
+                }
+            }
+
+            if (next == nullptr) {
+                break;
+            }
+
+            pv.push_back(*next);
+            board.move(*next);
+            s = piece_side_reverse(s);
+            attacker = !attacker;
+            movesLeft = childMovesLeft;
+        }
+
+        for (size_t i = 0; i < pv.size(); ++i) {
+            board.undo();
+        }
+
+        return pv;
+    }
+public:
+    struct Result {
+        uint32_t moves = 0;         // the mate is in this many attacker moves, 0 when none was proven.
+        uint64_t nodes = 0;
+        std::vector<Move> pv;
+    };
+
+    // the table takes at most mb megabytes, stop and deadline of _control are honoured.
+    MateSolver(uint32_t mb, SearchControl& _control) : control{ _control }, nodes{ 0 } {
+        size_t count = 1;
+        while (count * 2 * sizeof(Entry) <= static_cast<size_t>(mb) * 1024 * 1024) {
+            count *= 2;
+        }
+
+        entries.reset(new Entry[count]);
+        mask = count - 1;
+    }
+
+    // tries mates in 1, 2, ... up to maxMoves moves for side s, so the shortest one is found.
+    Result solve(Board& board, Side s, uint32_t maxMoves) {
+        Result result;
+
+        for (uint32_t n = 1; n <= maxMoves && !control.stop.load(); ++n) {
+            mid(board, s, true, n, infinity, infinity);
+
+            if (lookup(key_of(board.hash(), n)).pn == 0) {
+                result.moves = n;
+                result.pv = proof_line(board, s, n);
+                break;
+            }
+        }
+
+        result.nodes = nodes;
+        control.nodes += nodes;
+        return result;
+    }
+};
+
+class ColorPrinter {
+public:
+    enum color {
+        black,
+        red,
+        green,
+        yellow,
+        blue,
+        magenta,
+        cyan,
+        white,
+        bold_black,
+        bold_red,
+        bold_green,
+        bold_yellow,
+        bold_blue,
+        bold_magenta,
+        bold_cyan,
+        bold_white,
+        reset
+    };
+
+    ColorPrinter() {
+        #ifdef _WIN32
+        CONSOLE_SCREEN_BUFFER_INFO csbiInfo;
+        hOutHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+        GetConsoleScreenBufferInfo(hOutHandle, &csbiInfo);
+        oldColorAttrs = csbiInfo.wAttributes;
+        #endif
+    }
+
+    ~ColorPrinter() {
+        reset_color();
+    }
+
+    template<typename T>
+    ColorPrinter& operator<<(T&& printable) {
+        if constexpr (std::is_same_v<T, color>) {
+            if (printable == color::reset) {
+                reset_color();
+            }
+            else {
+                set_color(printable);
+            }
+        }
+        else {
+            std::cout << printable;
+        }
+
+        return *this;
+    }
+private:
+    void set_color(color c) {
+        #ifdef _WIN32
+        SetConsoleTextAttribute(hOutHandle, get_windows_color_attr(c));
+        #else
+        switch(c) {
+            case color::black:
+                std::cout << "\033[30m"; break;
+            case color::red:
+                std::cout << "\033[31m"; break;
+            case color::green:
+                std::cout << "\033[32m"; break;
+            case color::yellow:       
+                std::cout << "\033[33m"; break;
+            case color::blue:         
+                std::cout << "\033[34m"; break;
+            case color::magenta:      
+                std::cout << "\033[35m"; break;
+            case color::cyan:         
+                std::cout << "\033[36m"; break;
+            case color::white:        
+                std::cout << "\033[37m"; break;
+            case color::bold_black:    
+                std::cout << "\033[1m\033[30m"; break;
+            case color::bold_red:      
+                std::cout << "\033[1m\033[31m"; break;
+            case color::bold_green:    
+                std::cout << "\033[1m\033[32m"; break;
+            case color::bold_yellow:   
+                std::cout << "\033[1m\033[33m"; break;
+            case color::bold_blue:     
+                std::cout << "\033[1m\033[34m"; break;
+            case color::bold_magenta:  
+                std::cout << "\033[1m\033[35m"; break;
+            case color::bold_cyan:     
+                std::cout << "\033[1m\033[36m"; break;
+            case color::bold_white:  
+            default:  
+                std::cout << "\033[1m\033[37m"; break;
+        }
+        #endif
+    }
+
+    void reset_color() {
+        #ifdef _WIN32
+        SetConsoleTextAttribute(hOutHandle, oldColorAttrs);
+        #else
+        std::cout << "\033[0m";
+        #endif
+    }
+
+#ifdef _WIN32
+    WORD get_windows_color_attr(color c) {
         switch(c) {
             case color::black: 
                 return 0;
@@ -1081,282 +3977,1714 @@ private:
         };
     }
 
-    HANDLE hOutHandle;
-    WORD oldColorAttrs;
-#endif
+    HANDLE hOutHandle;
+    WORD oldColorAttrs;
+#endif
+};
+
+// reads the console on its own thread, so the game loop never blocks on getline while Elysia is thinking.
+class InputReader {
+    struct Shared {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<std::string> lines;
+        bool closed = false;
+    };
+
+    std::shared_ptr<Shared> shared;
+public:
+    InputReader() : shared{ std::make_shared<Shared>() } {
+        // getline cannot be interrupted, so the reader is detached and keeps the shared state alive by itself.
+        std::thread{ [sh = shared]() {
+            std::string line;
+
+            while (std::getline(std::cin, line)) {
+                std::lock_guard<std::mutex> lock{ sh->mtx };
+                sh->lines.push_back(std::move(line));
+                sh->cv.notify_one();
+            }
+
+            std::lock_guard<std::mutex> lock{ sh->mtx };
+            sh->closed = true;
+            sh->cv.notify_one();
+        } }.detach();
+    }
+
+    // waits at most timeout for a line, a closed console is reported as "quit".
+    bool pop(std::string& line, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock{ shared->mtx };
+
+        if (!shared->cv.wait_for(lock, timeout, [this]() { return !shared->lines.empty() || shared->closed; })) {
+            return false;
+        }
+
+        if (shared->lines.empty()) {
+            line = "quit";
+        }
+        else {
+            line = std::move(shared->lines.front());
+            shared->lines.pop_front();
+        }
+
+        return true;
+    }
+
+    void pop(std::string& line) {
+        while (!pop(line, std::chrono::milliseconds{ 1000 })) {}
+    }
+};
+
+// everything that can be tuned per host without recompiling.
+// options come from the command line as "--key value" or "--key=value", or from a config file with one
+// "key = value" per line and '#' comments. later settings override earlier ones.
+struct EngineOptions {
+    std::string mode = "play";          // play, uci, bench, scaling, perft, attacks, copymake or lazyeval.
+    uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    uint32_t hashMb = 64;
+    uint32_t mateHashMb = 16;
+    uint32_t depth = 3;                 // search depth, or the perft depth in perft mode.
+    uint32_t movetimeMs = 0;            // 0 means no time limit.
+    std::string evalPath = ".";
+    std::string fen;                    // start position for perft, empty means the initial position.
+    std::string affinity = "off";       // off, auto or a cpu list like "0-3,8".
+    std::vector<int32_t> cpus;          // affinity resolved.
+    uint32_t benchRounds = 1;
+    ParallelMode parallel = ParallelMode::root_split;
+    SearchAlgorithm algorithm = SearchAlgorithm::alpha_beta;
+    uint32_t playouts = 20000;
+    bool copyMake = false;
+    bool etc = true;
+    std::vector<uint32_t> lmpCounts;        // by plies left - 1, empty means off.
+    std::vector<int32_t> historyMargins;    // the same.
+    bool positionalEval = false;        // mobility and king safety on top of material.
+    bool lazyEval = true;
+    std::string tracePath;              // empty means no tracing.
+    bool counters = false;              // hardware counters in bench and perft.
+    bool deterministic = false;
+
+    static uint32_t to_number(const std::string& key, const std::string& value) {
+        try {
+            size_t used;
+            unsigned long n = std::stoul(value, &used);
+
+            if (used != value.size() || n > std::numeric_limits<uint32_t>::max()) {
+                throw std::out_of_range{ value };
+            }
+
+            return static_cast<uint32_t>(n);
+        }
+        catch (const std::logic_error&) {
+            throw std::invalid_argument{ "option " + key + " needs a non-negative number, got: " + value };
+        }
+    }
+
+    // "off" gives an empty list, anything else is numbers separated by commas.
+    static std::vector<uint32_t> to_numbers(const std::string& key, const std::string& value) {
+        std::vector<uint32_t> numbers;
+        if (value == "off") {
+            return numbers;
+        }
+
+        std::stringstream ss{ value };
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            numbers.push_back(to_number(key, trim(item)));
+        }
+
+        if (numbers.empty()) {
+            throw std::invalid_argument{ "option " + key + " needs off or numbers like 8,16, got: " + value };
+        }
+
+        return numbers;
+    }
+
+    static std::string trim(const std::string& str) {
+        size_t begin = str.find_first_not_of(" \t\r");
+        size_t end = str.find_last_not_of(" \t\r");
+        return begin == std::string::npos ? std::string{} : str.substr(begin, end - begin + 1);
+    }
+
+    SearchLimits search_limits() const {
+        SearchLimits limits;
+        limits.depth = depth;
+        limits.movetimeMs = movetimeMs;
+        limits.threads = threads;
+        limits.cpus = cpus;
+        limits.parallel = parallel;
+        limits.algorithm = algorithm;
+        limits.playouts = playouts;
+        limits.treeMb = hashMb;
+        limits.copyMake = copyMake;
+        limits.etc = etc;
+        limits.lmpCounts = lmpCounts;
+        limits.historyMargins = historyMargins;
+        limits.deterministic = deterministic;
+        return limits;
+    }
+
+    void set(const std::string& key, const std::string& value) {
+        if (key == "mode") {
+            if (value != "play" && value != "uci" && value != "bench" && value != "scaling" && value != "perft" && value != "attacks" && value != "copymake" && value != "lazyeval") {
+                throw std::invalid_argument{ "unknown mode: " + value };
+            }
+
+            mode = value;
+        }
+        else if (key == "threads") {
+            threads = std::max(to_number(key, value), 1u);
+        }
+        else if (key == "hash") {
+            hashMb = std::max(to_number(key, value), 1u);
+        }
+        else if (key == "mate-hash") {
+            mateHashMb = std::max(to_number(key, value), 1u);
+        }
+        else if (key == "depth") {
+            depth = to_number(key, value);
+        }
+        else if (key == "movetime") {
+            movetimeMs = to_number(key, value);
+        }
+        else if (key == "eval-path") {
+            evalPath = value;
+        }
+        else if (key == "fen") {
+            fen = value;
+        }
+        else if (key == "affinity") {
+            cpus = ThreadAffinity::resolve(value);
+            affinity = value;
+        }
+        else if (key == "parallel") {
+            if (value == "root") {
+                parallel = ParallelMode::root_split;
+            }
+            else if (value == "abdada") {
+                parallel = ParallelMode::abdada;
+            }
+            else {
+                throw std::invalid_argument{ "unknown parallel search: " + value };
+            }
+        }
+        else if (key == "bench-rounds") {
+            benchRounds = std::max(to_number(key, value), 1u);
+        }
+        else if (key == "search") {
+            if (value == "alphabeta") {
+                algorithm = SearchAlgorithm::alpha_beta;
+            }
+            else if (value == "mcts") {
+                algorithm = SearchAlgorithm::mcts;
+            }
+            else if (value == "mtdf") {
+                algorithm = SearchAlgorithm::mtdf;
+            }
+            else {
+                throw std::invalid_argument{ "unknown search: " + value };
+            }
+        }
+        else if (key == "playouts") {
+            playouts = to_number(key, value);
+        }
+        else if (key == "make") {
+            if (value != "undo" && value != "copy") {
+                throw std::invalid_argument{ "option make needs undo or copy, got: " + value };
+            }
+
+            copyMake = value == "copy";
+        }
+        else if (key == "eval") {
+            if (value != "material" && value != "full") {
+                throw std::invalid_argument{ "unknown eval: " + value };
+            }
+
+            positionalEval = value == "full";
+        }
+        else if (key == "lazy-eval") {
+            if (value != "on" && value != "off") {
+                throw std::invalid_argument{ "option lazy-eval needs on or off, got: " + value };
+            }
+
+            lazyEval = value == "on";
+        }
+        else if (key == "trace") {
+            tracePath = value;
+        }
+        else if (key == "etc") {
+            if (value != "on" && value != "off") {
+                throw std::invalid_argument{ "option etc needs on or off, got: " + value };
+            }
+
+            etc = value == "on";
+        }
+        else if (key == "lmp") {
+            lmpCounts = to_numbers(key, value);
+        }
+        else if (key == "history-pruning") {
+            historyMargins.clear();
+
+            for (uint32_t margin : to_numbers(key, value)) {
+                if (margin > static_cast<uint32_t>(std::numeric_limits<int32_t>::max())) {
+                    throw std::invalid_argument{ "option history-pruning needs numbers up to " + std::to_string(std::numeric_limits<int32_t>::max()) + ", got: " + value };
+                }
+
+                historyMargins.push_back(static_cast<int32_t>(margin));
+            }
+        }
+        else if (key == "deterministic") {
+            if (value != "on" && value != "off") {
+                throw std::invalid_argument{ "option deterministic needs on or off, got: " + value };
+            }
+
+            deterministic = value == "on";
+        }
+        else if (key == "counters") {
+            if (value != "on" && value != "off") {
+                throw std::invalid_argument{ "option counters needs on or off, got: " + value };
+            }
+
+            counters = value == "on";
+        }
+        else if (key == "config") {
+            load_config(value);
+        }
+        else {
+            throw std::invalid_argument{ "unknown option: " + key };
+        }
+    }
+
+    void load_config(const std::string& path) {
+        std::ifstream in{ path };
+        if (!in.is_open()) {
+            throw std::invalid_argument{ "load_config failed, cannot open file: " + path };
+        }
+
+        std::string line;
+        while (std::getline(in, line)) {
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) {
+                continue;
+            }
+
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                throw std::invalid_argument{ "load_config: expect 'key = value' in " + path + ": " + line };
+            }
+
+            set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)));
+        }
+    }
+
+    // returns false when the usage was asked for.
+    bool parse_command_line(int argc, char* argv[]) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+
+            if (arg == "-h" || arg == "--help") {
+                return false;
+            }
+
+            if (arg.rfind("--", 0) != 0) {
+                throw std::invalid_argument{ "unexpected argument: " + arg };
+            }
+
+            size_t eq = arg.find('=');
+            if (eq != std::string::npos) {
+                set(arg.substr(2, eq - 2), arg.substr(eq + 1));
+            }
+            else if (i + 1 < argc) {
+                set(arg.substr(2), argv[++i]);
+            }
+            else {
+                throw std::invalid_argument{ "option " + arg + " needs a value" };
+            }
+        }
+
+        return true;
+    }
+
+    static void show_usage() {
+        std::cout << "usage: Chinese_Chess_With_AI [--key value]...\n\n";
+        std::cout << "    --mode MODE                   play, uci, bench, scaling, perft, attacks, copymake or lazyeval,\n";
+        std::cout << "                                  default play.\n";
+        std::cout << "                                  scaling runs bench positions with 1, 2, 4, ... threads.\n";
+        std::cout << "                                  copymake compares copy make with make and undo.\n";
+        std::cout << "                                  lazyeval checks that lazy eval keeps the root scores of full eval.\n";
+        std::cout << "    --threads N                   search threads, default is the number of cpus.\n";
+        std::cout << "    --hash MB                     hash table size, and the mcts tree size, default 64.\n";
+        std::cout << "    --mate-hash MB                table size of the mate solver, default 16.\n";
+        std::cout << "    --depth N                     search depth (walk depth in perft and attacks mode), default 3.\n";
+        std::cout << "    --movetime MS                 time limit of a search, 0 for none, default 0.\n";
+        std::cout << "    --eval-path DIR               where the piece value tables are, default '.'.\n";
+        std::cout << "    --fen FEN                     perft start position, default the initial one.\n";
+        std::cout << "    --affinity off|auto|LIST      pin search threads to cpus, 'auto' fills physical cores\n";
+        std::cout << "                                  before SMT siblings, LIST is like 0-3,8. default off.\n";
+        std::cout << "    --parallel root|abdada        how threads share a search, default root.\n";
+        std::cout << "    --search alphabeta|mcts|mtdf  search algorithm, default alphabeta. mtdf runs on one thread.\n";
+        std::cout << "    --make undo|copy              alpha beta plays moves on one board and takes them back,\n";
+        std::cout << "                                  or copies the position for every ply. default undo.\n";
+        std::cout << "    --playouts N                  playouts of an mcts search, 0 for no limit, default 20000.\n";
+        std::cout << "    --bench-rounds N              how many times bench searches its positions, default 1.\n";
+        std::cout << "    --eval material|full          full adds mobility and king safety, default material.\n";
+        std::cout << "    --lazy-eval on|off            skip the full eval terms when they cannot matter, default on.\n";
+        std::cout << "    --etc on|off                  look up the children of a node in the table before searching\n";
+        std::cout << "                                  them (enhanced transposition cutoffs), default on.\n";
+        std::cout << "    --lmp off|N,N...              with d plies left, skip quiet moves from the d-th N on in the move\n";
+        std::cout << "                                  list (late move pruning), like 16,24. default off.\n";
+        std::cout << "    --history-pruning off|N,N...  with d plies left, skip quiet moves with a history score below\n";
+        std::cout << "                                  minus the d-th N, like 0,64. default off.\n";
+        std::cout << "    --deterministic on|off        alpha beta gives the same moves and node counts on every run with\n";
+        std::cout << "                                  the same threads, always splits at the root, default off.\n";
+        std::cout << "    --counters on|off             read cpu counters in bench and perft (linux perf events), per\n";
+        std::cout << "                                  node figures for move generation, eval and search, default off.\n";
+        std::cout << "    --trace FILE                  record search spans per thread and write them as chrome trace\n";
+        std::cout << "                                  json to FILE on exit.\n";
+        std::cout << "    --config FILE                 read 'key = value' lines with the same keys.\n";
+    }
+};
+
+class Game {
+    // what the background search is doing for us.
+    enum class Task {
+        none,
+        elysia_move,
+        prompt,
+        mate
+    };
+
+    static constexpr std::chrono::milliseconds poll_interval{ 50 };
+
+    Board board;
+    ColorPrinter cprinter;
+    InputReader input;
+    SearchLimits limits;
+    TranspositionTable tt;
+    uint32_t mateHashMb;
+    MateSolver::Result mateResult;
+    Side userSide;
+    Side elysiaSide;
+    bool running;
+    bool promptShown;
+
+    Task task;
+    std::unique_ptr<SearchControl> control;
+    std::future<Move> searchResult;
+    std::chrono::system_clock::time_point searchStart;
+    std::mutex infoMutex;
+    std::vector<SearchInfo> pendingInfos;
+
+    void clear_screen() {
+        #ifdef _WIN32
+        system("cls");
+        #else
+        system("clear");
+        #endif
+    }
+
+    void show_board_on_console() {
+        clear_screen();
+
+        int n = Board::real_row_num - 1;
+
+        cprinter << "\n    +----------------------------+\n";
+        for (int32_t r = Board::row_begin; r <= Board::row_end; ++r) {
+            if (r == Board::chu_han_line) {
+                cprinter << "    |-~-~-~-~-~-~-~-~-~-~-~-~-~-~|\n";
+                cprinter << "    |-~-~-~-~-~-~-~-~-~-~-~-~-~-~|\n";
+            }
+
+            cprinter << " " << ColorPrinter::bold_yellow << n-- << ColorPrinter::reset;
+            cprinter << "  | ";
+
+            for (int32_t c = Board::col_begin; c <= Board::col_end; ++c){
+                Piece p = board.get(r, c);
+
+                if (piece_side(p) == Side::up) {
+                    cprinter << " " << ColorPrinter::bold_red << piece_char(p) << " " << ColorPrinter::reset;
+                }
+                else if (piece_side(p) == Side::down) {
+                    cprinter << " " << ColorPrinter::bold_blue << piece_char(p) << " " << ColorPrinter::reset;
+                }
+                else {
+                    cprinter << " " << ColorPrinter::white << piece_char(p) << " " << ColorPrinter::reset;
+                }
+            }
+
+            cprinter << "|\n";
+        }
+
+        cprinter << "    +----------------------------+\n";
+        cprinter << ColorPrinter::bold_green << "\n       a  b  c  d  e  f  g  h  i\n\n" << ColorPrinter::reset;
+    }
+
+    // while Elysia is thinking the page is printed below her progress, without waiting for a key.
+    void show_help_page(){
+        if (task == Task::none) {
+            clear_screen();
+        }
+
+        cprinter << "\n=======================================\n";
+        cprinter << ColorPrinter::bold_blue << "Help Page\n\n" << ColorPrinter::reset;
+        cprinter << "    1. help         - this page.\n";
+        cprinter << "    2. b2e2         - input like this will be parsed as a move.\n";
+        cprinter << "    3. undo         - undo the previous move.\n";
+        cprinter << "    4. exit or quit - exit the game.\n";
+        cprinter << "    5. remake       - remake the game.\n";
+        cprinter << "    6. prompt       - give me a best move.\n";
+        cprinter << "    7. stop         - stop thinking, and use the best move found so far.\n";
+        cprinter << "    8. mate N       - look for a mate in N moves for you, checking all the way.\n\n";
+        cprinter << "  The characters on the board have the following relationships: \n\n";
+        cprinter << "    P -> Elysia side pawn.\n";
+        cprinter << "    C -> Elysia side cannon.\n";
+        cprinter << "    R -> Elysia side rook.\n";
+        cprinter << "    N -> Elysia side knight.\n";
+        cprinter << "    B -> Elysia side bishop.\n";
+        cprinter << "    A -> Elysia side advisor.\n";
+        cprinter << "    G -> Elysia side general.\n";
+        cprinter << "    p -> our pawn.\n";
+        cprinter << "    c -> our cannon.\n";
+        cprinter << "    r -> our rook.\n";
+        cprinter << "    n -> our knight.\n";
+        cprinter << "    b -> our bishop.\n";
+        cprinter << "    a -> our advisor.\n";
+        cprinter << "    g -> our general.\n";
+        cprinter << "    . -> no piece here.\n";
+        cprinter << "=======================================\n";
+
+        if (task == Task::none) {
+            cprinter << "Press any key to continue.\n";
+
+            // ignore any input.    
+            std::string line;
+            input.pop(line);
+            show_board_on_console();
+        }
+    }
+
+    void show_welcom_page() {
+        cprinter << "Welcome to cnchess, ";
+        
+        if (userSide == Side::up) {
+            cprinter << ColorPrinter::bold_red << "upper" << ColorPrinter::reset << " side is you, try to beat Elysia!\n";
+        }
+        else {
+            cprinter << ColorPrinter::bold_blue << "down" << ColorPrinter::reset << " side is you, try to beat Elysia!\n";
+        }
+
+        cprinter << "type 'help' to see the help page.\n\n";
+    }
+
+    bool check_rule(const Move& mv) {
+        return MovesGen::is_pseudo_legal(board, userSide, mv);
+    }
+
+    bool is_input_a_move(const std::string& input) {
+        return Notation::is_move(input);
+    }
+
+    Move input_to_move(const std::string& input) {
+        return Notation::to_move(input);
+    }
+
+    std::string desc_move(const Move& mv) {
+        return Notation::desc(mv);
+    }
+
+    bool is_win(Side s) {
+        bool up_general_alive = false;
+        bool down_general_alive = false;
+
+        for (int32_t r = Board::nine_palace_up_top; r <= Board::nine_palace_up_bottom; ++r) {
+            for (int32_t c = Board::nine_palace_up_left; c <= Board::nine_palace_up_right; ++c) {
+                if (board.get(r, c) == P_UG) {
+                    up_general_alive = true;
+                    break;
+                }
+            }
+        }
+
+        for (int32_t r = Board::nine_palace_down_top; r <= Board::nine_palace_down_bottom; ++r) {
+            for (int32_t c = Board::nine_palace_down_left; c <= Board::nine_palace_down_right; ++c) {
+                if (board.get(r, c) == P_DG) {
+                    down_general_alive = true;
+                    break;
+                }
+            }
+        }
+
+        if (up_general_alive && down_general_alive) {
+            return false;
+        }
+        else {
+            return s == Side::up ? up_general_alive : down_general_alive;
+        }
+    }
+
+    void start_search(Side s, Task t) {
+        task = t;
+        control = std::make_unique<SearchControl>();
+        control->tt = &tt;
+        control->report = [this](const SearchInfo& info) {
+            std::lock_guard<std::mutex> lock{ infoMutex };
+            pendingInfos.push_back(info);
+        };
+
+        searchStart = std::chrono::system_clock::now();
+        searchResult = std::async(std::launch::async, [this, s]() {
+            Board tempBoard = board;
+            return BestMoveGenParallel::gen(tempBoard, s, limits, *control);
+        });
+    }
+
+    void start_mate_search(const std::string& arg) {
+        uint32_t moves;
+        try {
+            moves = EngineOptions::to_number("mate", arg);
+        }
+        catch (const std::invalid_argument&) {
+            cprinter << "usage: mate N\n\n";
+            return;
+        }
+
+        cprinter << "looking for a mate in " << moves << ", type 'stop' to give up.\n";
+
+        task = Task::mate;
+        control = std::make_unique<SearchControl>();
+        if (limits.movetimeMs != 0) {
+            control->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{ limits.movetimeMs };
+        }
+
+        searchStart = std::chrono::system_clock::now();
+        searchResult = std::async(std::launch::async, [this, moves]() {
+            Board tempBoard = board;
+            MateSolver solver{ mateHashMb, *control };
+
+            mateResult = solver.solve(tempBoard, userSide, moves);
+            return mateResult.pv.empty() ? Move{} : mateResult.pv.front();
+        });
+    }
+
+    // stops the search and throws its result away.
+    void cancel_search() {
+        if (task == Task::none) {
+            return;
+        }
+
+        control->stop = true;
+        searchResult.wait();
+        task = Task::none;
+
+        std::lock_guard<std::mutex> lock{ infoMutex };
+        pendingInfos.clear();
+    }
+
+    void show_search_infos(Side s) {
+        std::vector<SearchInfo> infos;
+        {
+            std::lock_guard<std::mutex> lock{ infoMutex };
+            infos.swap(pendingInfos);
+        }
+
+        for (const SearchInfo& info : infos) {
+            cprinter << "    depth " << info.depth;
+            cprinter << ", score " << (s == Side::up ? -info.score : info.score);
+            cprinter << ", time " << info.timeMs << " ms, pv";
+
+            for (const Move& mv : info.pv) {
+                cprinter << " " << desc_move(mv);
+            }
+
+            cprinter << "\n";
+        }
+    }
+
+    void poll_search() {
+        Side s = task == Task::elysia_move ? elysiaSide : userSide;
+        show_search_infos(s);
+
+        if (searchResult.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready) {
+            return;
+        }
+
+        Move mv = searchResult.get();
+        show_search_infos(s);
+
+        auto end_time = std::chrono::system_clock::now();
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(end_time - searchStart).count();
+
+        Task finished = task;
+        task = Task::none;
+        promptShown = false;
+
+        if (finished == Task::mate) {
+            if (mateResult.moves == 0) {
+                cprinter << "no mate found, " << mateResult.nodes << " nodes, time cost " << seconds << " seconds\n\n";
+                return;
+            }
+
+            cprinter << "mate in " << mateResult.moves << ":" << ColorPrinter::bold_yellow;
+            for (const Move& pvMove : mateResult.pv) {
+                cprinter << " " << desc_move(pvMove);
+            }
+            cprinter << ColorPrinter::reset << ", " << mateResult.nodes << " nodes, time cost " << seconds << " seconds\n\n";
+            return;
+        }
+
+        if (finished == Task::prompt) {
+            cprinter << "maybe you can try: " << ColorPrinter::bold_yellow << desc_move(mv) << ColorPrinter::reset;
+            cprinter << ", piece is " << piece_char(board.get(mv.from));
+            cprinter << ", time cost " << seconds << " seconds\n\n";
+            return;
+        }
+
+        Piece p = board.get(mv.from);
+        board.move(mv);
+        show_board_on_console();
+
+        cprinter << ColorPrinter::bold_magenta << "Elysia" << ColorPrinter::reset << " thought " << seconds << " seconds, ";
+        cprinter << "moves: " << desc_move(mv);
+        cprinter << ", piece is '" << piece_char(p) << "'\n\n";
+
+        if (is_win(elysiaSide)) {
+            running = false;
+            cprinter << ColorPrinter::bold_red << "Sorry, Elysia wins!\n\n" << ColorPrinter::reset;
+            return;
+        }
+    }
+
+    void show_prompt() {
+        cprinter << "thinking for you, type 'stop' to get the answer now.\n";
+        start_search(userSide, Task::prompt);
+    }
+
+    void handle_move(const std::string& input) {
+        if (!is_input_a_move(input)) {
+            cprinter << "unknown command\n\n";
+            return;
+        }
+
+        Move mv = input_to_move(input);
+        if (piece_side(board.get(mv.from)) != userSide) {
+            cprinter << "this is not your piece, you cannot move it\n\n";
+            return;
+        }
+
+        if (!check_rule(mv)) {
+            cprinter << "this move does not fit the rule\n\n";
+            return;
+        }
+
+        board.move(mv);
+        show_board_on_console();
+        if (is_win(userSide)) {
+            running = false;
+            cprinter << ColorPrinter::bold_yellow << "Congratulations! You win!\n\n" << ColorPrinter::reset;
+            return;
+        }
+
+        cprinter << ColorPrinter::bold_magenta << "Elysia" << ColorPrinter::reset << " thinking... type 'stop' to make her move now.\n";
+        start_search(elysiaSide, Task::elysia_move);
+    }
+
+    void handle_command(const std::string& input) {
+        if (input == "help") {
+            show_help_page();
+        }
+        else if (input == "undo") {
+            if (task == Task::elysia_move) {    // take back our move that Elysia is thinking about.
+                cancel_search();
+                board.undo();
+            }
+            else {
+                cancel_search();
+                board.undo();
+                board.undo();
+            }
+
+            show_board_on_console();
+        }
+        else if (input == "quit" || input == "exit") {
+            cancel_search();
+            cprinter << "Bye.\n\n";
+            running = false;
+        }
+        else if (input == "remake") {
+            cancel_search();
+            board.clear();
+            show_board_on_console();
+        }
+        else if (input == "stop") {
+            if (task != Task::none) {
+                control->stop = true;
+            }
+        }
+        else if (task != Task::none) {
+            cprinter << "Elysia is thinking, type 'stop' to interrupt her.\n";
+        }
+        else if (input == "prompt") {
+            show_prompt();
+        }
+        else if (input.rfind("mate ", 0) == 0) {
+            start_mate_search(EngineOptions::trim(input.substr(5)));
+        }
+        else {
+            handle_move(input);
+        }
+    }
+public:
+    explicit Game(const EngineOptions& options)
+        : board{}, cprinter{}, input{}, limits{ options.search_limits() }, tt{ options.hashMb }, mateHashMb{ options.mateHashMb }, userSide{ Side::down }, elysiaSide{ Side::up }, running{ true }, promptShown{ false }, task{ Task::none }
+    {}
+
+    ~Game() {
+        cancel_search();
+    }
+
+    // the search runs in the background, so commands are still read and handled while Elysia is thinking.
+    void run() {
+        std::string line;
+        show_board_on_console();
+        show_welcom_page();
+
+        while (running) {
+            if (task == Task::none && !promptShown) {
+                cprinter << "Your Turn: ";
+                std::cout.flush();
+                promptShown = true;
+            }
+
+            if (input.pop(line, poll_interval)) {
+                promptShown = false;
+                handle_command(line);
+            }
+
+            if (task != Task::none) {
+                poll_search();
+            }
+        }
+    }
 };
 
-class Game {
+// speaks the UCI protocol on the console, using xiangqi FEN and moves like "h2e2".
+class UciEngine {
+    static constexpr std::chrono::milliseconds poll_interval{ 20 };
+    static constexpr uint32_t infinite_depth = 64;
+
+    EngineOptions& options;
+    InputReader input;
     Board board;
-    ColorPrinter cprinter;
-    uint32_t searchDepth;
-    Side userSide;
-    Side elysiaSide;
+    Side sideToMove;
     bool running;
 
-    void clear_screen() {
-        #ifdef _WIN32
-        system("cls");
-        #else
-        system("clear");
-        #endif
+    std::unique_ptr<SearchControl> control;
+    std::future<Move> searchResult;
+    bool searching;
+    std::mutex outMutex;
+    std::unique_ptr<TranspositionTable> tt;
+
+    void send(const std::string& line) {
+        std::lock_guard<std::mutex> lock{ outMutex };
+        std::cout << line << std::endl;
+    }
+
+    void wait_search() {
+        if (searching) {
+            send("bestmove " + Notation::desc(searchResult.get()));
+            searching = false;
+        }
+    }
+
+    void stop_search() {
+        if (searching) {
+            control->stop = true;
+            wait_search();
+        }
+    }
+
+    void handle_position(std::istringstream& in) {
+        std::string token;
+        in >> token;
+
+        if (token == "startpos") {
+            board.clear();
+            sideToMove = Side::down;
+            in >> token;
+        }
+        else if (token == "fen") {
+            std::string fen;
+            while (in >> token && token != "moves") {
+                fen += fen.empty() ? token : " " + token;
+            }
+
+            sideToMove = board.load_fen(fen);
+        }
+
+        if (token == "moves") {
+            while (in >> token) {
+                if (!Notation::is_move(token)) {
+                    throw std::invalid_argument{ "bad move: " + token };
+                }
+
+                board.move(Notation::to_move(token));
+                sideToMove = piece_side_reverse(sideToMove);
+            }
+        }
+    }
+
+    void handle_go(std::istringstream& in) {
+        SearchLimits limits = options.search_limits();
+        uint32_t mateMoves = 0;
+        std::string token;
+
+        while (in >> token) {
+            if (token == "depth") {
+                in >> limits.depth;
+                limits.depth = std::max<uint32_t>(limits.depth, 1) - 1;   // the root ply is not counted by the searcher.
+            }
+            else if (token == "movetime") {
+                in >> limits.movetimeMs;
+                limits.depth = infinite_depth;
+            }
+            else if (token == "infinite") {
+                limits.depth = infinite_depth;
+                limits.movetimeMs = 0;
+            }
+            else if (token == "mate") {
+                in >> mateMoves;
+            }
+        }
+
+        Side s = sideToMove;
+        control = std::make_unique<SearchControl>();
+        control->tt = tt.get();
+        control->report = [this, s](const SearchInfo& info) {
+            std::string line = "info depth " + std::to_string(info.depth);
+            line += " score cp " + std::to_string(s == Side::up ? -info.score : info.score);
+            line += " time " + std::to_string(info.timeMs) + " nodes " + std::to_string(info.nodes);
+            line += " qnodes " + std::to_string(info.qnodes) + " pv";
+
+            for (const Move& mv : info.pv) {
+                line += " " + Notation::desc(mv);
+            }
+
+            send(line);
+        };
+
+        searching = true;
+        searchResult = std::async(std::launch::async, [this, limits, s, mateMoves]() {
+            Board tempBoard = board;
+
+            // without a proven mate the normal search picks the move, with whatever time is left.
+            if (mateMoves != 0) {
+                if (limits.movetimeMs != 0) {
+                    control->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{ limits.movetimeMs };
+                }
+
+                MateSolver solver{ options.mateHashMb, *control };
+                MateSolver::Result result = solver.solve(tempBoard, s, mateMoves);
+
+                if (result.moves != 0) {
+                    std::string line = "info score mate " + std::to_string(result.moves) + " nodes " + std::to_string(result.nodes) + " pv";
+                    for (const Move& mv : result.pv) {
+                        line += " " + Notation::desc(mv);
+                    }
+
+                    send(line);
+                    return result.pv.front();
+                }
+            }
+
+            return BestMoveGenParallel::gen(tempBoard, s, limits, *control);
+        });
+    }
+
+    void handle_command(const std::string& line) {
+        std::istringstream in{ line };
+        std::string command;
+        in >> command;
+
+        if (command == "uci") {
+            send("id name Elysia");
+            send("id author elysia");
+            send("option name Threads type spin default " + std::to_string(options.threads) + " min 1 max 1024");
+            send("option name Hash type spin default " + std::to_string(options.hashMb) + " min 1 max 65536");
+            send("uciok");
+        }
+        else if (command == "isready") {
+            send("readyok");
+        }
+        else if (command == "setoption") {
+            std::string token, name, value;
+            in >> token >> name >> token >> value;
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char ch) { return std::tolower(ch); });
+            options.set(name, value);
+
+            if (name == "hash") {
+                tt = std::make_unique<TranspositionTable>(options.hashMb);
+            }
+        }
+        else if (command == "ucinewgame") {
+            stop_search();
+            TraceSpan span{ "tt clear" };
+            tt->clear();
+            board.clear();
+            sideToMove = Side::down;
+        }
+        else if (command == "position") {
+            stop_search();
+            handle_position(in);
+        }
+        else if (command == "go") {
+            stop_search();
+            handle_go(in);
+        }
+        else if (command == "stop") {
+            stop_search();
+        }
+        else if (command == "quit") {
+            stop_search();
+            running = false;
+        }
+    }
+public:
+    explicit UciEngine(EngineOptions& _options)
+        : options{ _options }, input{}, board{}, sideToMove{ Side::down }, running{ true }, searching{ false },
+          tt{ std::make_unique<TranspositionTable>(options.hashMb) }
+    {}
+
+    void run() {
+        std::string line;
+
+        while (running) {
+            if (input.pop(line, poll_interval)) {
+                try {
+                    handle_command(line);
+                }
+                catch (const std::exception& e) {
+                    send(std::string{ "info string " } + e.what());
+                }
+            }
+
+            if (searching && searchResult.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready) {
+                wait_search();
+            }
+        }
+    }
+};
+
+// counts the leaves of the legal move tree, to validate the move generator.
+// subtree counts are cached by (position, depth), the last ply only counts moves, and the root moves are
+// shared by options.threads threads the same way as in BestMoveGenParallel.
+class Perft {
+    // lockless like the TranspositionTable, check holds key ^ count.
+    class Table {
+        struct Entry {
+            std::atomic<uint64_t> check{ 0 };
+            std::atomic<uint64_t> count{ 0 };
+        };
+
+        std::unique_ptr<Entry[]> entries;
+        size_t mask;
+
+        static uint64_t key_of(uint64_t hash, uint32_t depth) noexcept {
+            return hash ^ (depth * 0x9E3779B97F4A7C15ull);
+        }
+    public:
+        explicit Table(uint32_t mb) {
+            size_t count = 1;
+            while (count * 2 * sizeof(Entry) <= static_cast<size_t>(mb) * 1024 * 1024) {
+                count *= 2;
+            }
+
+            entries.reset(new Entry[count]);
+            mask = count - 1;
+        }
+
+        bool probe(uint64_t hash, uint32_t depth, uint64_t& count) const noexcept {
+            uint64_t key = key_of(hash, depth);
+            Entry& e = entries[key & mask];
+            uint64_t stored = e.count.load(std::memory_order_relaxed);
+
+            if ((e.check.load(std::memory_order_relaxed) ^ stored) != key || stored == 0) {
+                return false;
+            }
+
+            count = stored;
+            return true;
+        }
+
+        void store(uint64_t hash, uint32_t depth, uint64_t count) noexcept {
+            uint64_t key = key_of(hash, depth);
+            Entry& e = entries[key & mask];
+
+            e.count.store(count, std::memory_order_relaxed);
+            e.check.store(key ^ count, std::memory_order_relaxed);
+        }
+    };
+
+    static uint64_t count(Board& board, Side s, uint32_t depth, Table& table) {
+        if (depth == 0) {
+            return 1;
+        }
+
+        if (depth == 1) {
+            return MovesGen::count_legal_moves(board, s);
+        }
+
+        uint64_t total = 0;
+        if (table.probe(board.hash(), depth, total)) {
+            return total;
+        }
+
+        for (const Move& mv : MovesGen::gen_legal_moves(board, s)) {
+            board.move(mv);
+            total += count(board, piece_side_reverse(s), depth - 1, table);
+            board.undo();
+        }
+
+        table.store(board.hash(), depth, total);
+        return total;
+    }
+
+    static uint64_t count_parallel(const Board& board, Side s, uint32_t depth, uint32_t threads, Table& table) {
+        Board rootBoard = board;
+        auto moves = MovesGen::gen_legal_moves(rootBoard, s);
+
+        if (depth <= 1) {
+            return depth == 0 ? 1 : moves.size();
+        }
+
+        std::atomic<size_t> next{ 0 };
+        std::atomic<uint64_t> total{ 0 };
+        std::vector<std::thread> workers;
+
+        for (uint32_t i = 0; i < std::min<size_t>(std::max<uint32_t>(threads, 1), moves.size()); ++i) {
+            workers.emplace_back([&]() {
+                Board tempBoard = board;
+
+                for (size_t m = next++; m < moves.size(); m = next++) {
+                    tempBoard.move(moves[m]);
+                    total += count(tempBoard, piece_side_reverse(s), depth - 1, table);
+                    tempBoard.undo();
+                }
+            });
+        }
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        return total;
     }
+public:
+    static void run(const EngineOptions& options) {
+        Board board;
+        Side s = options.fen.empty() ? Side::down : board.load_fen(options.fen);
+        Table table{ options.hashMb };
 
-    void show_board_on_console() {
-        clear_screen();
+        std::cout << "perft " << board.to_fen(s) << " threads " << options.threads << " hash " << options.hashMb << " MB\n";
 
-        int n = Board::real_row_num - 1;
+        std::optional<PerfCounters> counters;
+        if (options.counters) {
+            counters.emplace();
 
-        cprinter << "\n    +----------------------------+\n";
-        for (int32_t r = Board::row_begin; r <= Board::row_end; ++r) {
-            if (r == Board::chu_han_line) {
-                cprinter << "    |-~-~-~-~-~-~-~-~-~-~-~-~-~-~|\n";
-                cprinter << "    |-~-~-~-~-~-~-~-~-~-~-~-~-~-~|\n";
+            if (!counters->available()) {
+                std::cout << "counters unavailable: " << counters->last_error() << "\n";
+                counters.reset();
+            }
+        }
+
+        for (uint32_t depth = 1; depth <= options.depth; ++depth) {
+            if (counters) {
+                counters->start();
             }
 
-            cprinter << " " << ColorPrinter::bold_yellow << n-- << ColorPrinter::reset;
-            cprinter << "  | ";
+            auto start_time = std::chrono::steady_clock::now();
+            uint64_t leaves = count_parallel(board, s, depth, options.threads, table);
+            auto end_time = std::chrono::steady_clock::now();
 
-            for (int32_t c = Board::col_begin; c <= Board::col_end; ++c){
-                Piece p = board.get(r, c);
+            std::cout << "depth " << depth << " nodes " << leaves;
+            std::cout << " time " << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count() << " ms\n";
 
-                if (piece_side(p) == Side::up) {
-                    cprinter << " " << ColorPrinter::bold_red << p << " " << ColorPrinter::reset;
-                }
-                else if (piece_side(p) == Side::down) {
-                    cprinter << " " << ColorPrinter::bold_blue << p << " " << ColorPrinter::reset;
-                }
-                else {
-                    cprinter << " " << ColorPrinter::white << p << " " << ColorPrinter::reset;
-                }
+            // leaves are counted in bulk and subtrees come from the table, so these are per leaf, not per move made.
+            if (counters) {
+                PerfCounters::show("  counters", counters->stop(), leaves);
             }
+        }
+    }
+};
 
-            cprinter << "|\n";
+// searches a fixed set of positions and reports node counts and speed.
+// with thread affinity on, every round is also run unpinned, to show what pinning is worth.
+class Bench {
+    static constexpr const char* positions[] = {
+        "rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RNBAKABNR w",
+        "rnbakab1r/9/1c4nc1/p1p1p1p1p/9/9/P1P1P1P1P/1C2C4/9/RNBAKABNR w",
+        "r1bakab1r/9/1cn3nc1/p1p1p1p1p/9/2P6/P3P1P1P/1C2C1N2/9/RNBAKAB1R b",
+        "3akab2/9/4b4/p3p3p/2p6/6R2/P3P3P/4B4/4A4/2BAK4 w",
+    };
+
+    struct Result {
+        Move mv;
+        uint64_t nodes;
+        uint64_t qnodes;
+        uint64_t passes;    // mtdf only.
+        int64_t us;
+        int32_t score;      // of the last reported iteration.
+    };
+
+    // the table is cleared first, so each search is the same no matter the order.
+    static Result search_position(const char* fen, const SearchLimits& limits, TranspositionTable& tt) {
+        Board board;
+        Side s = board.load_fen(fen);
+        SearchControl control;
+        control.tt = &tt;
+        int32_t score = 0;
+        control.report = [&score](const SearchInfo& info) { score = info.score; };
+        {
+            TraceSpan span{ "tt clear" };
+            tt.clear();
         }
 
-        cprinter << "    +----------------------------+\n";
-        cprinter << ColorPrinter::bold_green << "\n       a  b  c  d  e  f  g  h  i\n\n" << ColorPrinter::reset;
+        auto start_time = std::chrono::steady_clock::now();
+        Move mv = BestMoveGenParallel::gen(board, s, limits, control);
+        auto end_time = std::chrono::steady_clock::now();
+
+        return Result{ mv, control.nodes, control.qnodes, control.passes, std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count(), score };
     }
 
-    void show_help_page(){
-        clear_screen();
+    // calls at_node on every position up to depth plies from the root, returns how many there were.
+    template<typename AtNode>
+    static uint64_t walk(Board& board, Side s, uint32_t depth, AtNode&& at_node) {
+        at_node(board, s);
 
-        cprinter << "\n=======================================\n";
-        cprinter << ColorPrinter::bold_blue << "Help Page\n\n" << ColorPrinter::reset;
-        cprinter << "    1. help         - this page.\n";
-        cprinter << "    2. b2e2         - input like this will be parsed as a move.\n";
-        cprinter << "    3. undo         - undo the previous move.\n";
-        cprinter << "    4. exit or quit - exit the game.\n";
-        cprinter << "    5. remake       - remake the game.\n";
-        cprinter << "    6. prompt       - give me a best move.\n\n";
-        cprinter << "  The characters on the board have the following relationships: \n\n";
-        cprinter << "    P -> Elysia side pawn.\n";
-        cprinter << "    C -> Elysia side cannon.\n";
-        cprinter << "    R -> Elysia side rook.\n";
-        cprinter << "    N -> Elysia side knight.\n";
-        cprinter << "    B -> Elysia side bishop.\n";
-        cprinter << "    A -> Elysia side advisor.\n";
-        cprinter << "    G -> Elysia side general.\n";
-        cprinter << "    p -> our pawn.\n";
-        cprinter << "    c -> our cannon.\n";
-        cprinter << "    r -> our rook.\n";
-        cprinter << "    n -> our knight.\n";
-        cprinter << "    b -> our bishop.\n";
-        cprinter << "    a -> our advisor.\n";
-        cprinter << "    g -> our general.\n";
-        cprinter << "    . -> no piece here.\n";
-        cprinter << "=======================================\n";
-        cprinter << "Press any key to continue.\n";
+        if (depth == 0) {
+            return 1;
+        }
 
-        // ignore any input.    
-        std::string line;
-        std::getline(std::cin, line);
+        uint64_t nodes = 1;
+        for (const Move& mv : MovesGen::gen_legal_moves(board, s)) {
+            board.move(mv);
+            nodes += walk(board, piece_side_reverse(s), depth - 1, at_node);
+            board.undo();
+        }
+
+        return nodes;
     }
 
-    void show_welcom_page() {
-        cprinter << "Welcome to cnchess, ";
-        
-        if (userSide == Side::up) {
-            cprinter << ColorPrinter::bold_red << "upper" << ColorPrinter::reset << " side is you, try to beat Elysia!\n";
+    static uint64_t walk_undo(Board& board, Side s, uint32_t depth) {
+        if (depth == 0) {
+            return 1;
         }
-        else {
-            cprinter << ColorPrinter::bold_blue << "down" << ColorPrinter::reset << " side is you, try to beat Elysia!\n";
+
+        uint64_t nodes = 1;
+        for (const Move& mv : MovesGen::gen_possible_moves(board, s)) {
+            board.move(mv);
+            nodes += walk_undo(board, piece_side_reverse(s), depth - 1);
+            board.undo();
         }
 
-        cprinter << "type 'help' to see the help page.\n\n";
+        return nodes;
     }
 
-    bool check_rule(const Move& mv) {
-        auto moves = MovesGen::gen_possible_moves(board, userSide);
-        return std::find(moves.cbegin(), moves.cend(), mv) != moves.cend();
-    }
+    static uint64_t walk_copy(const Position& position, Side s, uint32_t depth) {
+        if (depth == 0) {
+            return 1;
+        }
 
-    bool is_input_a_move(const std::string& input) {
-        if (input.size() < 4){
-            return false;
+        uint64_t nodes = 1;
+        for (const Move& mv : MovesGen::gen_possible_moves(position, s)) {
+            Position child = position;
+            child.make(mv);
+            nodes += walk_copy(child, piece_side_reverse(s), depth - 1);
         }
 
-        return  (input[0] >= 'a' && input[0] <= 'i') &&
-                (input[1] >= '0' && input[1] <= '9') &&
-                (input[2] >= 'a' && input[2] <= 'i') &&
-                (input[3] >= '0' && input[3] <= '9');
+        return nodes;
     }
 
-    Move input_to_move(const std::string& input) {
-        Move mv;
+    // returns the nps of one round.
+    static double run_round(const SearchLimits& limits, TranspositionTable& tt, bool verbose) {
+        uint64_t totalNodes = 0;
+        uint64_t totalQnodes = 0;
+        uint64_t totalPasses = 0;
+        int64_t totalUs = 0;
+        bool mtdf = limits.algorithm == SearchAlgorithm::mtdf;
+
+        for (const char* fen : positions) {
+            Result result = search_position(fen, limits, tt);
+            totalNodes += result.nodes;
+            totalQnodes += result.qnodes;
+            totalPasses += result.passes;
+            totalUs += result.us;
+
+            if (verbose) {
+                std::cout << fen << "\n    bestmove " << Notation::desc(result.mv) << " nodes " << result.nodes << " qnodes " << result.qnodes;
+                std::cout << (mtdf ? " passes " + std::to_string(result.passes) : "") << " time " << result.us / 1000 << " ms\n";
+            }
+        }
 
-        mv.from.row = Board::row_begin + 9 - (input[1] - '0');
-        mv.from.col = Board::col_begin + (input[0] - 'a');
-        mv.to.row   = Board::row_begin + 9 - (input[3] - '0');
-        mv.to.col   = Board::col_begin + (input[2] - 'a');
+        if (verbose) {
+            std::cout << "total nodes " << totalNodes << " qnodes " << totalQnodes << " time " << totalUs / 1000 << " ms\n";
+        }
 
-        return mv;
+        // every search runs limits.depth + 1 iterations without a time limit.
+        if (verbose && mtdf) {
+            uint64_t iterations = std::size(positions) * (limits.depth + 1);
+            std::cout << "mtdf passes " << totalPasses << " per iteration " << std::fixed << std::setprecision(2);
+            std::cout << static_cast<double>(totalPasses) / iterations << "\n";
+            std::cout.unsetf(std::ios::fixed);
+        }
+
+        return totalNodes * 1e6 / std::max<int64_t>(totalUs, 1);
     }
 
-    std::string desc_move(const Move& mv) {
-        std::string buf;
+    static void show_nps(const char* name, const std::vector<double>& samples) {
+        double mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+        double variance = 0;
 
-        buf += static_cast<char>(mv.from.col - Board::col_begin + 'a');
-        buf += static_cast<char>(9 - (mv.from.row - Board::row_begin) + '0');
-        buf += static_cast<char>(mv.to.col - Board::col_begin + 'a');
-        buf += static_cast<char>(9 - (mv.to.row - Board::row_begin) + '0');
-        return buf;
-    }
+        for (double nps : samples) {
+            variance += (nps - mean) * (nps - mean);
+        }
 
-    bool is_win(Side s) {
-        bool up_general_alive = false;
-        bool down_general_alive = false;
+        double deviation = std::sqrt(variance / samples.size());
 
-        for (int32_t r = Board::nine_palace_up_top; r <= Board::nine_palace_up_bottom; ++r) {
-            for (int32_t c = Board::nine_palace_up_left; c <= Board::nine_palace_up_right; ++c) {
-                if (board.get(r, c) == P_UG) {
-                    up_general_alive = true;
-                    break;
-                }
-            }
+        std::cout << name << " nps " << static_cast<uint64_t>(mean);
+        std::cout << " stddev " << static_cast<uint64_t>(deviation);
+        std::cout << " (" << std::fixed << std::setprecision(1) << (mean > 0 ? deviation * 100 / mean : 0) << "%)\n";
+        std::cout.unsetf(std::ios::fixed);
+    }
+public:
+    static void run(const EngineOptions& options) {
+        SearchLimits limits = options.search_limits();
+        SearchLimits unpinned = limits;
+        unpinned.cpus.clear();
+
+        std::cout << "bench depth " << limits.depth << " threads " << limits.threads;
+        std::cout << " parallel " << (limits.parallel == ParallelMode::abdada ? "abdada" : "root") << " affinity " << options.affinity;
+        for (size_t i = 0; i < limits.cpus.size() && i < limits.threads; ++i) {
+            std::cout << (i == 0 ? " (" : ",") << limits.cpus[i];
         }
+        std::cout << (limits.cpus.empty() ? "\n" : ")\n");
 
-        for (int32_t r = Board::nine_palace_down_top; r <= Board::nine_palace_down_bottom; ++r) {
-            for (int32_t c = Board::nine_palace_down_left; c <= Board::nine_palace_down_right; ++c) {
-                if (board.get(r, c) == P_DG) {
-                    down_general_alive = true;
-                    break;
-                }
+        std::vector<double> pinnedNps, unpinnedNps;
+        TranspositionTable tt{ options.hashMb };
+
+        for (uint32_t round = 0; round < options.benchRounds; ++round) {
+            pinnedNps.push_back(run_round(limits, tt, round == 0));
+
+            if (!limits.cpus.empty()) {
+                unpinnedNps.push_back(run_round(unpinned, tt, false));
             }
         }
 
-        if (up_general_alive && down_general_alive) {
-            return false;
+        if (limits.cpus.empty()) {
+            show_nps("bench", pinnedNps);
         }
         else {
-            return s == Side::up ? up_general_alive : down_general_alive;
+            show_nps("pinned  ", pinnedNps);
+            show_nps("unpinned", unpinnedNps);
         }
-    }
-
-    void show_prompt() {
-        auto start_time = std::chrono::system_clock::now();
-        Move mv = BestMoveGenParallel::gen(board, userSide, searchDepth);
-        auto end_time = std::chrono::system_clock::now();
 
-        cprinter << "maybe you can try: " << ColorPrinter::bold_yellow << desc_move(mv) << ColorPrinter::reset;
-        cprinter << ", piece is " << board.get(mv.from);
-        cprinter << ", time cost " << std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time).count() << " seconds\n\n";
+        if (options.counters) {
+            run_counters(options, tt);
+        }
     }
 
-    void handle_move(const std::string& input) {
-        if (!is_input_a_move(input)) {
-            cprinter << "unknown command\n\n";
-            return;
-        }
+    // how many walked positions run_counters keeps at once, about 16 MB of them.
+    static constexpr size_t counter_batch = 1 << 16;
 
-        Move mv = input_to_move(input);
-        if (piece_side(board.get(mv.from)) != userSide) {
-            cprinter << "this is not your piece, you cannot move it\n\n";
+    // counts on every position within options.depth plies of the bench positions: generating the moves,
+    // evaluating, and then one full search of the positions, each per node. the walk grows quickly with
+    // the depth, so the positions are measured a batch at a time instead of all kept first.
+    static void run_counters(const EngineOptions& options, TranspositionTable& tt) {
+        PerfCounters counters;
+        if (!counters.available()) {
+            std::cout << "counters unavailable: " << counters.last_error() << "\n";
             return;
         }
 
-        if (!check_rule(mv)) {
-            cprinter << "this move does not fit the rule\n\n";
-            return;
+        std::vector<std::pair<Position, Side>> nodes;
+        nodes.reserve(counter_batch);
+
+        std::vector<Move> moves;
+        uint64_t checksum = 0;
+        uint64_t walked = 0;
+        PerfCounters::Values movegen{};
+        PerfCounters::Values eval{};
+
+        auto measure = [&]() {
+            counters.start();
+            for (const auto& [position, s] : nodes) {
+                moves.clear();
+                MovesGen::gen_possible_moves(position, s, moves);
+                checksum += moves.size();
+            }
+            PerfCounters::add(movegen, counters.stop());
+
+            counters.start();
+            for (const auto& [position, s] : nodes) {
+                checksum += static_cast<uint64_t>(ScoreEvaluator::evaluate(position));
+            }
+            PerfCounters::add(eval, counters.stop());
+
+            walked += nodes.size();
+            nodes.clear();
+        };
+
+        for (const char* fen : positions) {
+            Board board;
+            Side s = board.load_fen(fen);
+            walk(board, s, options.depth, [&nodes, &measure](const Board& b, Side side) {
+                nodes.emplace_back(b, side);
+
+                if (nodes.size() == counter_batch) {
+                    measure();
+                }
+            });
         }
+        measure();
 
-        board.move(mv);
-        show_board_on_console();
-        if (is_win(userSide)) {
-            running = false;
-            cprinter << ColorPrinter::bold_yellow << "Congratulations! You win!\n\n" << ColorPrinter::reset;
-            return;
+        PerfCounters::show("movegen", movegen, walked);
+        PerfCounters::show("eval", eval, walked);
+
+        SearchLimits limits = options.search_limits();
+        uint64_t searched = 0;
+
+        counters.start();
+        for (const char* fen : positions) {
+            searched += search_position(fen, limits, tt).nodes;
         }
+        PerfCounters::show("search", counters.stop(), searched);
 
-        cprinter << ColorPrinter::bold_magenta << "Elysia" << ColorPrinter::reset << " thinking...\n";
+        // keeps the loops above from being optimized away.
+        std::cout << "checksum " << checksum << "\n";
+    }
 
-        auto start_time = std::chrono::system_clock::now();
-        Move elysiaMove = BestMoveGenParallel::gen(board, elysiaSide, searchDepth);
-        auto end_time = std::chrono::system_clock::now();
+    // walks every legal line of the positions to options.depth three times: finding checks by scanning from
+    // the general, with attack maps kept up to date by move and undo, and with the maps made again from
+    // scratch at every node. another walk checks the incremental maps against the ones made from scratch.
+    // the last ones generate every move, find which ones give check by making them and with
+    // MovesGen::gives_check, and count the moves where the two disagree.
+    static void run_attacks(const EngineOptions& options) {
+        std::cout << "attacks depth " << options.depth << " positions " << std::size(positions) << "\n";
+
+        auto measure = [&options](const char* name, bool tracking, auto&& at_node) {
+            uint64_t nodes = 0;
+            uint64_t found = 0;
+            auto start_time = std::chrono::steady_clock::now();
+
+            for (const char* fen : positions) {
+                Board board;
+                Side s = board.load_fen(fen);
+                board.set_attack_tracking(tracking);
+                nodes += walk(board, s, options.depth, [&found, &at_node](Board& b, Side side) { found += at_node(b, side); });
+            }
 
-        Piece p = board.get(elysiaMove.from);
-        board.move(elysiaMove);
-        show_board_on_console();
+            auto end_time = std::chrono::steady_clock::now();
+            int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
 
-        cprinter << ColorPrinter::bold_magenta << "Elysia" << ColorPrinter::reset << " thought " << std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time).count() << " seconds, ";
-        cprinter << "moves: " << desc_move(elysiaMove);
-        cprinter << ", piece is '" << p << "'\n\n";
+            std::cout << std::left << std::setw(12) << name << std::right << " nodes " << nodes << " found " << found;
+            std::cout << " time " << ns / 1000000 << " ms " << ns / std::max<uint64_t>(nodes, 1) << " ns/node\n";
+        };
 
-        if (is_win(elysiaSide)) {
-            running = false;
-            cprinter << ColorPrinter::bold_red << "Sorry, Elysia wins!\n\n" << ColorPrinter::reset;
-            return;
-        }
+        auto in_check = [](const Board& board, Side s) -> uint64_t { return MovesGen::is_in_check(board, s); };
+
+        measure("on demand", false, in_check);
+        measure("incremental", true, in_check);
+        measure("recompute", false, [](const Board& board, Side s) -> uint64_t {
+            Pos general = board.find_general(s);
+            return general == Pos{} || board.compute_attack_counts()[s == Side::up ? 1 : 0][Board::square(general)] != 0;
+        });
+        measure("mismatches", true, [](const Board& board, Side) -> uint64_t {
+            return board.attack_counts() != board.compute_attack_counts();
+        });
+
+        auto make_check = [](Board& board, const Move& mv, Side s) {
+            board.move(mv);
+            bool check = MovesGen::is_in_check(board, piece_side_reverse(s));
+            board.undo();
+            return check;
+        };
+
+        // only generates the moves, what is left of the next two is what finding the checks costs.
+        measure("moves", false, [](const Board& board, Side s) -> uint64_t {
+            return MovesGen::gen_possible_moves(board, s).size();
+        });
+        measure("make check", false, [&make_check](Board& board, Side s) -> uint64_t {
+            uint64_t checks = 0;
+            for (const Move& mv : MovesGen::gen_possible_moves(board, s)) {
+                checks += make_check(board, mv, s);
+            }
+            return checks;
+        });
+        measure("gives check", false, [](const Board& board, Side s) -> uint64_t {
+            uint64_t checks = 0;
+            for (const Move& mv : MovesGen::gen_possible_moves(board, s)) {
+                checks += MovesGen::gives_check(board, mv);
+            }
+            return checks;
+        });
+        measure("mismatches", false, [&make_check](Board& board, Side s) -> uint64_t {
+            uint64_t mismatches = 0;
+            for (const Move& mv : MovesGen::gen_possible_moves(board, s)) {
+                mismatches += make_check(board, mv, s) != MovesGen::gives_check(board, mv);
+            }
+            return mismatches;
+        });
+
+        // every move of every piece to every square checked by the rules, against the generated moves.
+        measure("pseudo legal", false, [](const Board& board, Side s) -> uint64_t {
+            static constexpr int32_t square_num = Board::row_num * Board::col_num;
+            std::vector<bool> generated(square_num * square_num);
+            for (const Move& mv : MovesGen::gen_possible_moves(board, s)) {
+                generated[Board::square(mv.from) * square_num + Board::square(mv.to)] = true;
+            }
+
+            uint64_t mismatches = 0;
+            for (int32_t r = Board::row_begin; r <= Board::row_end; ++r) {
+                for (int32_t c = Board::col_begin; c <= Board::col_end; ++c) {
+                    if (piece_side(board.get(r, c)) != s) {
+                        continue;
+                    }
+
+                    for (int32_t tr = Board::row_begin; tr <= Board::row_end; ++tr) {
+                        for (int32_t tc = Board::col_begin; tc <= Board::col_end; ++tc) {
+                            Move mv{ r, c, tr, tc };
+                            bool rules = MovesGen::is_pseudo_legal(board, s, mv);
+                            mismatches += rules != generated[Board::square(mv.from) * square_num + Board::square(mv.to)];
+                        }
+                    }
+                }
+            }
+
+            return mismatches;
+        });
     }
-public:
-    Game()
-        : board{}, cprinter{}, searchDepth{ 3 }, userSide{ Side::down }, elysiaSide{ Side::up }, running{ true }
-    {}
 
-    void run() {
-        std::string input;
-        show_board_on_console();
-        show_welcom_page();
+    // first walks the pseudo legal move tree of the positions to options.depth with move and undo and with a
+    // copy of the position per ply, then searches them single threaded both ways.
+    static void run_copy_make(const EngineOptions& options) {
+        std::cout << "copymake depth " << options.depth << " position " << sizeof(Position) << " bytes\n";
 
-        while (running) {
-            cprinter << "Your Turn: ";
-            std::getline(std::cin, input);
+        auto show = [](const char* name, uint64_t nodes, int64_t us) {
+            std::cout << std::left << std::setw(12) << name << std::right << " nodes " << nodes << " time " << us / 1000 << " ms ";
+            std::cout << us * 1000 / static_cast<int64_t>(std::max<uint64_t>(nodes, 1)) << " ns/node\n";
+        };
 
-            if (input == "help") {
-                show_help_page();
-                show_board_on_console();
+        for (bool copy : { false, true }) {
+            uint64_t nodes = 0;
+            auto start_time = std::chrono::steady_clock::now();
+
+            for (const char* fen : positions) {
+                Board board;
+                Side s = board.load_fen(fen);
+                nodes += copy ? walk_copy(board, s, options.depth) : walk_undo(board, s, options.depth);
             }
-            else if (input == "undo") {
-                board.undo();
-                board.undo();
-                show_board_on_console();
+
+            auto end_time = std::chrono::steady_clock::now();
+            show(copy ? "walk copy" : "walk undo", nodes, std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count());
+        }
+
+        SearchLimits limits = options.search_limits();
+        limits.threads = 1;
+        limits.algorithm = SearchAlgorithm::alpha_beta;
+        TranspositionTable tt{ options.hashMb };
+        std::vector<Move> undoMoves;
+
+        for (bool copy : { false, true }) {
+            limits.copyMake = copy;
+            uint64_t nodes = 0;
+            int64_t us = 0;
+            size_t same = 0;
+
+            for (size_t i = 0; i < std::size(positions); ++i) {
+                Result result = search_position(positions[i], limits, tt);
+                nodes += result.nodes;
+                us += result.us;
+
+                if (!copy) {
+                    undoMoves.push_back(result.mv);
+                }
+                same += result.mv == undoMoves[i];
             }
-            else if (input == "quit") {
-                cprinter << "Bye.\n\n";
-                return;
+
+            show(copy ? "search copy" : "search undo", nodes, us);
+            if (copy) {
+                std::cout << "same move " << same << "/" << std::size(positions) << "\n";
             }
-            else if (input == "exit") {
-                cprinter << "Bye.\n\n";
-                return;
+        }
+    }
+
+    // searches the positions single threaded with the full eval, lazy and not, and checks that every root
+    // score is the same. returns false when one is not.
+    static bool run_lazy_eval(const EngineOptions& options) {
+        SearchLimits limits = options.search_limits();
+        limits.threads = 1;
+        limits.algorithm = SearchAlgorithm::alpha_beta;
+        TranspositionTable tt{ options.hashMb };
+        std::vector<Result> full;
+        size_t same = 0;
+
+        std::cout << "lazyeval depth " << limits.depth << " positions " << std::size(positions) << "\n";
+
+        for (bool lazy : { false, true }) {
+            ScoreEvaluator::configure(true, lazy);
+            uint64_t nodes = 0;
+            int64_t us = 0;
+
+            for (size_t i = 0; i < std::size(positions); ++i) {
+                Result result = search_position(positions[i], limits, tt);
+                nodes += result.nodes;
+                us += result.us;
+
+                if (!lazy) {
+                    full.push_back(result);
+                    continue;
+                }
+
+                if (result.score == full[i].score) {
+                    ++same;
+                }
+                else {
+                    std::cout << "  score mismatch " << positions[i] << " full " << full[i].score << " lazy " << result.score << "\n";
+                }
             }
-            else if (input == "remake") {
-                board.clear();
-                show_board_on_console();
+
+            std::cout << (lazy ? "lazy" : "full") << " nodes " << nodes << " time " << us / 1000 << " ms\n";
+        }
+
+        ScoreEvaluator::configure(options.positionalEval, options.lazyEval);
+        std::cout << "same score " << same << "/" << std::size(positions) << "\n";
+        return same == std::size(positions);
+    }
+
+    // searches the positions to the same depth with 1, 2, 4, ... up to options.threads threads, and compares
+    // every thread count with the single thread run: time to depth speedup, extra nodes searched, nps scaling,
+    // and how many best moves are the same.
+    static void run_scaling(const EngineOptions& options) {
+        SearchLimits limits = options.search_limits();
+        TranspositionTable tt{ options.hashMb };
+
+        std::vector<uint32_t> threadCounts;
+        for (uint32_t t = 1; t < limits.threads; t *= 2) {
+            threadCounts.push_back(t);
+        }
+        threadCounts.push_back(limits.threads);
+
+        std::cout << "scaling depth " << limits.depth << " parallel " << (limits.parallel == ParallelMode::abdada ? "abdada" : "root");
+        std::cout << " positions " << std::size(positions) << "\n\n";
+        std::cout << std::left << std::setw(9) << "threads" << std::setw(12) << "time ms" << std::setw(10) << "speedup";
+        std::cout << std::setw(14) << "nodes" << std::setw(11) << "overhead%" << std::setw(12) << "nps";
+        std::cout << std::setw(13) << "nps scaling" << "same move\n";
+
+        std::vector<Result> single;
+        int64_t singleUs = 0;
+        uint64_t singleNodes = 0;
+
+        for (uint32_t threads : threadCounts) {
+            limits.threads = threads;
+
+            std::vector<Result> results;
+            int64_t totalUs = 0;
+            uint64_t totalNodes = 0;
+
+            for (const char* fen : positions) {
+                results.push_back(search_position(fen, limits, tt));
+                totalUs += results.back().us;
+                totalNodes += results.back().nodes;
             }
-            else if (input == "prompt") {
-                show_prompt();
+
+            if (single.empty()) {
+                single = results;
+                singleUs = totalUs;
+                singleNodes = totalNodes;
             }
-            else{
-                handle_move(input);   
+
+            size_t same = 0;
+            for (size_t i = 0; i < results.size(); ++i) {
+                same += results[i].mv == single[i].mv;
             }
+
+            double nps = totalNodes * 1e6 / std::max<int64_t>(totalUs, 1);
+            double singleNps = singleNodes * 1e6 / std::max<int64_t>(singleUs, 1);
+
+            std::cout << std::fixed << std::setprecision(2);
+            std::cout << std::setw(9) << threads << std::setw(12) << totalUs / 1000;
+            std::cout << std::setw(10) << static_cast<double>(singleUs) / std::max<int64_t>(totalUs, 1);
+            std::cout << std::setw(14) << totalNodes;
+            std::cout << std::setw(11) << (static_cast<double>(totalNodes) / std::max<uint64_t>(singleNodes, 1) - 1) * 100;
+            std::cout << std::setw(12) << static_cast<uint64_t>(nps);
+            std::cout << std::setw(13) << nps / std::max(singleNps, 1.0);
+            std::cout << same << "/" << results.size() << "\n";
+            std::cout.unsetf(std::ios::fixed);
         }
+
+        std::cout << std::right << "\noverhead is the percentage of extra nodes searched compared with one thread.\n";
     }
 };
 
-int main() {
-    ScoreEvaluator::init_values();
+static constexpr size_t trace_events_per_thread = 1 << 16;
+
+int main(int argc, char* argv[]) {
+    EngineOptions options;
+
+    try {
+        if (!options.parse_command_line(argc, argv)) {
+            EngineOptions::show_usage();
+            return 0;
+        }
+
+        ScoreEvaluator::init_values(options.evalPath);
+        ScoreEvaluator::configure(options.positionalEval, options.lazyEval);
+
+        if (!options.tracePath.empty()) {
+            Tracer::enable(options.threads + 1, trace_events_per_thread);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n\n";
+        EngineOptions::show_usage();
+        return 1;
+    }
+
+    if (options.mode == "uci") {
+        UciEngine engine{ options };
+        engine.run();
+    }
+    else if (options.mode == "bench") {
+        Bench::run(options);
+    }
+    else if (options.mode == "scaling") {
+        Bench::run_scaling(options);
+    }
+    else if (options.mode == "perft") {
+        Perft::run(options);
+    }
+    else if (options.mode == "attacks") {
+        Bench::run_attacks(options);
+    }
+    else if (options.mode == "copymake") {
+        Bench::run_copy_make(options);
+    }
+    else if (options.mode == "lazyeval") {
+        if (!Bench::run_lazy_eval(options)) {
+            return 1;
+        }
+    }
+    else {
+        Game game{ options };
+        game.run();
+    }
+
+    if (Tracer::enabled()) {
+        try {
+            Tracer::write(options.tracePath);
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
 
-    Game game;
-    game.run();
     return 0;
 }